@@ -21,6 +21,17 @@
 
 #include "AnimChuaOsc.hpp"
 
+// https://en.wikipedia.org/wiki/Multiscroll_attractor
+struct ChuaSystem {
+  double a, b, c, u;
+
+  void operator()(const double *s, double *ds) const {
+    ds[0] = a * (s[1] - s[0]);
+    ds[1] = s[0] - s[0]*s[2] + c*s[1] + u;
+    ds[2] = s[0]*s[1] - b*s[2];
+  }
+};
+
 AnimChuaOsc::AnimChuaOsc(PixelBuffer *_pixbuf) :
     Animation(_pixbuf) {
 
@@ -33,12 +44,12 @@ AnimChuaOsc::AnimChuaOsc(PixelBuffer *_pixbuf) :
   __t_next_color_change = __d_exp(_gen);
 
   // random starting position on unit sphere
-  srand((unsigned)time(0));
-  x = ((double) rand()) / ((double) RAND_MAX);
-  y = ((double) rand()) / ((double) RAND_MAX);
-  z = ((double) rand()) / ((double) RAND_MAX);
+  std::uniform_real_distribution<double> uniform;
+  double x = uniform(_gen);
+  double y = uniform(_gen);
+  double z = uniform(_gen);
   double norm = sqrt(x*x + y*y + z*z);
-  x /= norm; y /= norm; z /= norm;
+  __s[0] = x/norm; __s[1] = y/norm; __s[2] = z/norm;
   // x = 0.1; y = 0.3; z = -0.6;
 
   min_x = INFINITY; max_x = -INFINITY;
@@ -64,21 +75,19 @@ void AnimChuaOsc::_process(double dt) {
     __base_hue = __d_uniform(_gen);
   }
 
-  // https://en.wikipedia.org/wiki/Multiscroll_attractor
-  const double a = 36.0;
-  const double b = 3.0;
-  const double c = 20.0;
-
   double osc0 = sin(2.0 * M_PI * (1.0/(30*60.0)) * _t); // 30 minutes
-  double u = lin_scale(osc0, -1.0, 1.0, -15.0, 15.0);
+  ChuaSystem chua;
+  chua.a = 36.0;
+  chua.b = 3.0;
+  chua.c = 20.0;
+  chua.u = lin_scale(osc0, -1.0, 1.0, -15.0, 15.0);
 
-  double dx = a * (y - x);
-  double dy = x - x*z + c*y + u;
-  double dz = x*y - b*z;
+  __integrator.process(chua, __s, dt);
+  double ds[3];
+  chua(__s, ds);
 
-  x += dx * dt;
-  y += dy * dt;
-  z += dz * dt;
+  const double x = __s[0], y = __s[1], z = __s[2];
+  const double dx = ds[0], dy = ds[1], dz = ds[2];
 
   const float k1_decay = expf(-((float) dt)/300.0f);
   min_x = fmin(min_x*k1_decay, x); max_x = fmax(max_x*k1_decay, x);
@@ -94,17 +103,19 @@ void AnimChuaOsc::_process(double dt) {
 
   const int N = _pixbuf->getNumLeds();
 
-  int i_r = lin_scale(x, min_x, max_x, 0, N-1);
+  // the range is empty until the oscillator has moved, and infinite once it has diverged.
+  // The index would be NaN, so use the centre LED.
+  int i_r = (max_x > min_x && isfinite(max_x - min_x)) ? lin_scale(x, min_x, max_x, 0, N-1) : N/2;
   double l_x = lin_scale(fabs(dx), 0.0, __dx_range, 0.01, 0.55+0.1);
   // set_pixel_hsl_blend
   // set_pixel_mhroth_hsl_blend
   _pixbuf->set_pixel_mhroth_hsl_blend(i_r, __base_hue, 0.69f, l_x, 200.0f*dt, PixelBuffer::BlendMode::ACCUMULATE);
 
-  int i_g = lin_scale(y, min_y, max_y, 0, N-1);
+  int i_g = (max_y > min_y && isfinite(max_y - min_y)) ? lin_scale(y, min_y, max_y, 0, N-1) : N/2;
   double l_y = lin_scale(fabs(dy), 0.0, __dy_range, 0.01, 0.48+0.1);
   _pixbuf->set_pixel_mhroth_hsl_blend(i_g, __base_hue+30.0f, 0.36f, l_y, 200.0f*dt, PixelBuffer::BlendMode::ACCUMULATE);
 
-  int i_b = lin_scale(z, min_z, max_z, 0, N-1);
+  int i_b = (max_z > min_z && isfinite(max_z - min_z)) ? lin_scale(z, min_z, max_z, 0, N-1) : N/2;
   double l_z = lin_scale(fabs(dz), 0.0, __dz_range, 0.01, 0.48+0.1);
   _pixbuf->set_pixel_mhroth_hsl_blend(i_b, __base_hue-30.0f, 0.9f, l_z, 200.0f*dt, PixelBuffer::BlendMode::ACCUMULATE);
 }
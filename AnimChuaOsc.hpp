@@ -18,6 +18,7 @@
 #define _ANIM_CHUA_OSC_HPP_
 
 #include "Animation.hpp"
+#include "Integrator.hpp"
 
 class AnimChuaOsc: public Animation {
  public:
@@ -31,7 +32,8 @@ class AnimChuaOsc: public Animation {
  private:
   void _process(double dt) override;
 
-  double x, y, z;
+  Integrator<3> __integrator;
+  double __s[3]; // x, y, z
   double min_x, max_x, min_y, max_y, min_z, max_z;
   double __dx_range, __dy_range, __dz_range;
   std::exponential_distribution<float> __d_exp;
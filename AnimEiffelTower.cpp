@@ -21,13 +21,21 @@
 #define BASE_COLOR_G (132.0f/255.0f)
 #define BASE_COLOR_B (1.0f/255.0f)
 
+// the distribution of the shimmer
+#define SHIMMER_MU 1.0f
+#define SHIMMER_SIGMA 0.2f
+
 AnimEiffelTower::AnimEiffelTower(PixelBuffer *pixbuf) : Animation(pixbuf) {
   __mean_flash_time = 10.0f; // seconds
   __flash_decay_period = 0.1f; // seconds
   __shimmer_rate = 0.3f;
   __shimmer.resize(pixbuf->getNumLeds(), 1.0f);
-  __d_uniform = std::uniform_real_distribution<float>(0.0f, 1.0f);
-  __d_gauss = std::normal_distribution<float>(1.0f, 0.2f);
+  __r.resize(pixbuf->getNumLeds());
+  __g.resize(pixbuf->getNumLeds());
+  __b.resize(pixbuf->getNumLeds());
+  __a.resize(pixbuf->getNumLeds());
+  __p.resize(pixbuf->getNumLeds());
+  __z.resize(pixbuf->getNumLeds());
 
   _pixbuf->fill_rgb(BASE_COLOR_R, BASE_COLOR_G, BASE_COLOR_B);
 }
@@ -65,16 +73,23 @@ void AnimEiffelTower::_process(double dt) {
   float p_flash = 1.0f - expf(-dt/meanFlashTime);
   float r_flash_decay = 1.0f - expf(-dt/__flash_decay_period);
 
-  const int N = _pixbuf->getNumLeds();
-  for (int i = 0; i < N; i++) {
-    if (__d_uniform(_gen) < p_flash) {
-      _pixbuf->set_pixel_rgb_blend(i, 1.0f, 1.0f, 1.0f);
-    } else {
-      __shimmer[i] = __shimmer[i]*__shimmer_rate + __d_gauss(_gen)*(1.0f-__shimmer_rate);
-      float r = BASE_COLOR_R * __shimmer[i];
-      float g = BASE_COLOR_G * __shimmer[i];
-      float b = BASE_COLOR_B * __shimmer[i];
-      _pixbuf->set_pixel_rgb_blend(i, r, g, b, r_flash_decay, PixelBuffer::BlendMode::ADD);
+  _parallelFor([&](int tile, int begin, int end) {
+    // draw all of the tile's samples up front, four at a time
+    _tileGen[tile].uniform(__p.data()+begin, end-begin);
+    _tileGen[tile].normal(__z.data()+begin, end-begin, SHIMMER_MU, SHIMMER_SIGMA);
+    for (int i = begin; i < end; i++) {
+      if (__p[i] < p_flash) {
+        // NOTE: ADD with an alpha of 1 is the same as SET
+        __r[i] = 1.0f; __g[i] = 1.0f; __b[i] = 1.0f; __a[i] = 1.0f;
+      } else {
+        __shimmer[i] = __shimmer[i]*__shimmer_rate + __z[i]*(1.0f-__shimmer_rate);
+        __r[i] = BASE_COLOR_R * __shimmer[i];
+        __g[i] = BASE_COLOR_G * __shimmer[i];
+        __b[i] = BASE_COLOR_B * __shimmer[i];
+        __a[i] = r_flash_decay;
+      }
     }
-  }
+    _pixbuf->set_span_rgb_blend(begin, end-begin, __r.data()+begin, __g.data()+begin, __b.data()+begin,
+        __a.data()+begin, PixelBuffer::BlendMode::ADD);
+  });
 }
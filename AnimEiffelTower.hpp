@@ -36,8 +36,8 @@ class AnimEiffelTower: public Animation {
   float __flash_decay_period;
   float __shimmer_rate;
   std::vector<float> __shimmer;
-  std::uniform_real_distribution<float> __d_uniform;
-  std::normal_distribution<float> __d_gauss;
+  std::vector<float> __r, __g, __b, __a; // per-LED RGBA, blended as one span
+  std::vector<float> __p, __z; // per-LED uniform and normal samples of this frame
 };
 
 #endif // _ANIM_EIFEL_TOWER_HPP_
@@ -23,25 +23,41 @@
 AnimLighthouse::AnimLighthouse(PixelBuffer *pixbuf) :
     Animation(pixbuf) {
   __saturation = 0.67f;
+
+  const int N = pixbuf->getNumLeds();
+  __hue[0].assign(N, 0.0f);
+  __hue[1].assign(N, 60.0f);
+  __hue[2].assign(N, 210.0f);
+  __sat.assign(N, __saturation);
+  for (int k = 0; k < 3; ++k) __light[k].resize(N);
 }
 
 AnimLighthouse::~AnimLighthouse() {}
 
 void AnimLighthouse::setParameter(int index, float value) {
   switch (index) {
-    case 0: __saturation = value; break;
+    case 0: {
+      __saturation = value;
+      __sat.assign(__sat.size(), __saturation);
+      break;
+    }
     default: break;
   }
 }
 
 void AnimLighthouse::_process(double dt) {
-  const int N = _pixbuf->getNumLeds();
-  for (int i = 0; i < N; i++) {
-    float r = sinf((2.0 * M_PI * LIGHTHOUSE_FREQ_R * _t) + (2*M_PI/((i%11)+1)));
-    float g = sinf((2.0 * M_PI * LIGHTHOUSE_FREQ_G * _t) + (2*M_PI/((i%11)+1)));
-    float b = sinf((2.0 * M_PI * LIGHTHOUSE_FREQ_B * _t) + (2*M_PI/((i%11)+1)));
-    _pixbuf->set_pixel_hsl_blend(i, 0.0f, __saturation, fmaxf(0.0f,r));
-    _pixbuf->set_pixel_hsl_blend(i, 60.0f, __saturation, fmaxf(0.0f,g), 0.5f, PixelBuffer::BlendMode::ADD);
-    _pixbuf->set_pixel_hsl_blend(i, 210.0f, __saturation, fmaxf(0.0f,b), 0.333f, PixelBuffer::BlendMode::ADD);
-  }
+  _parallelFor([&](int /*tile*/, int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      float r = sinf((2.0 * M_PI * LIGHTHOUSE_FREQ_R * _t) + (2*M_PI/((i%11)+1)));
+      float g = sinf((2.0 * M_PI * LIGHTHOUSE_FREQ_G * _t) + (2*M_PI/((i%11)+1)));
+      float b = sinf((2.0 * M_PI * LIGHTHOUSE_FREQ_B * _t) + (2*M_PI/((i%11)+1)));
+      __light[0][i] = fmaxf(0.0f,r);
+      __light[1][i] = fmaxf(0.0f,g);
+      __light[2][i] = fmaxf(0.0f,b);
+    }
+    const int n = end - begin;
+    _pixbuf->set_span_hsl_blend(begin, n, __hue[0].data()+begin, __sat.data()+begin, __light[0].data()+begin);
+    _pixbuf->set_span_hsl_blend(begin, n, __hue[1].data()+begin, __sat.data()+begin, __light[1].data()+begin, 0.5f, PixelBuffer::BlendMode::ADD);
+    _pixbuf->set_span_hsl_blend(begin, n, __hue[2].data()+begin, __sat.data()+begin, __light[2].data()+begin, 0.333f, PixelBuffer::BlendMode::ADD);
+  });
 }
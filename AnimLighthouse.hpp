@@ -17,6 +17,8 @@
 #ifndef _ANIM_LIGHTHOUSE_HPP_
 #define _ANIM_LIGHTHOUSE_HPP_
 
+#include <vector>
+
 #include "Animation.hpp"
 
 class AnimLighthouse: public Animation {
@@ -32,6 +34,11 @@ class AnimLighthouse: public Animation {
   void _process(double dt) override;
 
   float __saturation;
+
+  // per-LED HSL values, one lightness array per hue
+  std::vector<float> __hue[3];
+  std::vector<float> __sat;
+  std::vector<float> __light[3];
 };
 
 #endif // _ANIM_LIGHTHOUSE_HPP_
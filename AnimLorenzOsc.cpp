@@ -20,25 +20,23 @@
 #include "AnimLorenzOsc.hpp"
 
 AnimLorenzOsc::AnimLorenzOsc(PixelBuffer *pixbuf) :
-    Animation(pixbuf) {
-  sigma = 10.0;
-  rho = 28.0;
-  beta = 8.0/3.0;
+    Animation(pixbuf), osc(10.0, 28.0, 8.0/3.0) {
 
   __rgb_sigma = 13.0f;
 
   // random starting position on unit sphere
-  srand((unsigned)time(0));
-  x = ((double) rand()) / ((double) RAND_MAX);
-  y = ((double) rand()) / ((double) RAND_MAX);
-  z = ((double) rand()) / ((double) RAND_MAX);
+  std::uniform_real_distribution<double> uniform;
+  double x = uniform(_gen);
+  double y = uniform(_gen);
+  double z = uniform(_gen);
   double norm = sqrt(x*x + y*y + z*z);
-  x /= norm; y /= norm; z /= norm;
+  osc.setPosition(x/norm, y/norm, z/norm);
 
-  min_x = INFINITY; max_x = -INFINITY;
-  min_y = INFINITY; max_y = -INFINITY;
-  min_z = INFINITY; max_z = -INFINITY;
   max_dx = -INFINITY; max_dy = -INFINITY; max_dz = -INFINITY;
+
+  __hue.resize(pixbuf->getNumLeds());
+  __sat.resize(pixbuf->getNumLeds());
+  __light.resize(pixbuf->getNumLeds());
 }
 
 AnimLorenzOsc::~AnimLorenzOsc() {
@@ -60,18 +58,14 @@ float AnimLorenzOsc::getParameter(int index) {
 }
 
 void AnimLorenzOsc::_process(double dt) {
-  // https://en.wikipedia.org/wiki/Lorenz_system
-  dx = sigma * (y - x);
-  dy = (x * (rho - z)) - y;
-  dz = x*y - beta*z;
-
-  x += dx * dt;
-  y += dy * dt;
-  z += dz * dt;
-
-  min_x = fmin(min_x, x); max_x = fmax(max_x, x);
-  min_y = fmin(min_y, y); max_y = fmax(max_y, y);
-  min_z = fmin(min_z, z); max_z = fmax(max_z, z);
+  double x, y, z, dx, dy, dz;
+  osc.process(dt, &x, &y, &z);
+  osc.getVelocity(&dx, &dy, &dz);
+
+  double min_x, max_x, min_y, max_y, min_z, max_z;
+  osc.getRangeX(&min_x, &max_x);
+  osc.getRangeY(&min_y, &max_y);
+  osc.getRangeZ(&min_z, &max_z);
   max_dx = fmax(fabs(dx), max_dx);
   max_dy = fmax(fabs(dx), max_dy);
   max_dx = fmax(fabs(dz), max_dz);
@@ -88,16 +82,27 @@ void AnimLorenzOsc::_process(double dt) {
 
   const float lightness_sigma_const = __rgb_sigma * M_SQRT_TAU * 0.67f;
 
-  for (int i = 0; i < N; ++i) {
-    float r = pdf_normal(i, i_r, __rgb_sigma) * lightness_sigma_const;
-    float g = pdf_normal(i, i_g, __rgb_sigma) * lightness_sigma_const;
-    float b = pdf_normal(i, i_b, __rgb_sigma) * lightness_sigma_const;
-
-    // _pixbuf->set_pixel_hsl_blend(i, 0.0f, r_sigma, r);
-    // _pixbuf->set_pixel_hsl_blend(i, 120.0f, g_sigma, g, 0.5f, PixelBuffer::BlendMode::ADD);
-    // _pixbuf->set_pixel_hsl_blend(i, 240.0f, b_sigma, b, 0.33f, PixelBuffer::BlendMode::ADD);
-    _pixbuf->set_pixel_mhroth_hsl_blend(i, 0.0f, r_sigma, r);
-    _pixbuf->set_pixel_mhroth_hsl_blend(i, 120.0f, g_sigma, g, 0.5f, PixelBuffer::BlendMode::ADD);
-    _pixbuf->set_pixel_mhroth_hsl_blend(i, 240.0f, b_sigma, b, 0.33f, PixelBuffer::BlendMode::ADD);
-  }
+  // one span per colour: (centre, hue, saturation, alpha, blend mode)
+  const int centre[3] = {i_r, i_g, i_b};
+  const float hue[3] = {0.0f, 120.0f, 240.0f};
+  const float sat[3] = {r_sigma, g_sigma, b_sigma};
+  const float alpha[3] = {1.0f, 0.5f, 0.33f};
+  const PixelBuffer::BlendMode mode[3] = {
+    PixelBuffer::BlendMode::SET, PixelBuffer::BlendMode::ADD, PixelBuffer::BlendMode::ADD
+  };
+
+  _parallelFor([&](int /*tile*/, int begin, int end) {
+    float *const h = __hue.data() + begin;
+    float *const s = __sat.data() + begin;
+    float *const l = __light.data() + begin;
+    for (int k = 0; k < 3; ++k) {
+      for (int i = begin; i < end; ++i) {
+        __hue[i] = hue[k];
+        __sat[i] = sat[k];
+        __light[i] = pdf_normal(i, centre[k], __rgb_sigma) * lightness_sigma_const;
+      }
+      // _pixbuf->set_span_hsl_blend(begin, end-begin, h, s, l, alpha[k], mode[k]);
+      _pixbuf->set_span_mhroth_hsl_blend(begin, end-begin, h, s, l, alpha[k], mode[k]);
+    }
+  });
 }
@@ -17,7 +17,10 @@
 #ifndef _ANIM_LORENZ_OSC_HPP_
 #define _ANIM_LORENZ_OSC_HPP_
 
+#include <vector>
+
 #include "Animation.hpp"
+#include "LorenzOscillator.hpp"
 
 class AnimLorenzOsc: public Animation {
  public:
@@ -33,11 +36,12 @@ class AnimLorenzOsc: public Animation {
  private:
   void _process(double dt) override;
 
-  double x, y, z, dx, dy, dz;
-  double beta, rho, sigma;
-  double min_x, max_x, min_y, max_y, min_z, max_z;
+  LorenzOscillator osc;
   double max_dx, max_dy, max_dz;
   float __rgb_sigma;
+
+  // per-LED HSL values, reused for each of the three colour spans
+  std::vector<float> __hue, __sat, __light;
 };
 
 #endif // _ANIM_LORENZ_OSC_HPP_
@@ -22,31 +22,24 @@
 #include "AnimLorenzOscFade.hpp"
 
 AnimLorenzOscFade::AnimLorenzOscFade(PixelBuffer *_pixbuf) :
-    Animation(_pixbuf) {
+    Animation(_pixbuf), osc(10.0, 28.0, 8.0/3.0) {
 
   alpha_mult = 200.0;
 
-  sigma = 10.0;
-  rho = 28.0;
-  beta = 8.0/3.0;
-
   // random starting position on unit sphere
-  srand((unsigned)time(0));
-  x = ((double) rand()) / ((double) RAND_MAX);
-  y = ((double) rand()) / ((double) RAND_MAX);
-  z = ((double) rand()) / ((double) RAND_MAX);
+  std::uniform_real_distribution<double> uniform;
+  double x = uniform(_gen);
+  double y = uniform(_gen);
+  double z = uniform(_gen);
   double norm = sqrt(x*x + y*y + z*z);
-  x /= norm; y /= norm; z /= norm;
+  osc.setPosition(x/norm, y/norm, z/norm);
 
-  min_x = INFINITY; max_x = -INFINITY;
-  min_y = INFINITY; max_y = -INFINITY;
-  min_z = INFINITY; max_z = -INFINITY;
   max_dx = -INFINITY; max_dy = -INFINITY; max_dz = -INFINITY;
   max_speed = -INFINITY;
 
-  c_h = 360.0 * ((double) rand()) / ((double) RAND_MAX);
-  c_s = (0.8-0.2) * ((double) rand()) / ((double) RAND_MAX) + 0.2;
-  // c_l = (0.6-0.2) * ((double) rand()) / ((double) RAND_MAX) + 0.2;
+  c_h = 360.0 * uniform(_gen);
+  c_s = (0.8-0.2) * uniform(_gen) + 0.2;
+  // c_l = (0.6-0.2) * uniform(_gen) + 0.2;
   c_l = 0.5;
 }
 
@@ -72,23 +65,19 @@ void AnimLorenzOscFade::_process(double dt) {
   double osc0 = sin(2.0 * M_PI * (1.0/(10*60.0)) * _t); // 10 minutes
   double osc1 = sin(2.0 * M_PI * (1.0/(2.5*60.0)) * _t); // 2.5 minutes
   double osc2 = sin(2.0 * M_PI * (1.0/(14*60.0)) * _t); // 14 minutes
-  sigma = lin_scale(osc0, -1.0, 1.0, 5.0, 15.0);
-  rho = lin_scale(osc1, -1.0, 1.0, 24.0, 36.0);
-  beta = lin_scale(osc2, -1.0, 1.0, 2.0, 3.33);
-
-  // https://en.wikipedia.org/wiki/Lorenz_system
-  dx = sigma * (y - x);
-  dy = (x * (rho - z)) - y;
-  dz = x*y - beta*z;
+  osc.setSigma(lin_scale(osc0, -1.0, 1.0, 5.0, 15.0));
+  osc.setRho(lin_scale(osc1, -1.0, 1.0, 24.0, 36.0));
+  osc.setBeta(lin_scale(osc2, -1.0, 1.0, 2.0, 3.33));
 
-  x += dx * dt;
-  y += dy * dt;
-  z += dz * dt;
+  double x, y, z, dx, dy, dz;
+  osc.process(dt, &x, &y, &z);
+  osc.getVelocity(&dx, &dy, &dz);
 
-  // measure coordinate bounds
-  min_x = fmin(min_x, x); max_x = fmax(max_x, x);
-  min_y = fmin(min_y, y); max_y = fmax(max_y, y);
-  min_z = fmin(min_z, z); max_z = fmax(max_z, z);
+  // coordinate bounds
+  double min_x, max_x, min_y, max_y, min_z, max_z;
+  osc.getRangeX(&min_x, &max_x);
+  osc.getRangeY(&min_y, &max_y);
+  osc.getRangeZ(&min_z, &max_z);
 
   // measure speed bounds (with auto reset)
   const double s_decay = expf(-dt/300.0); // over 300 seconds
@@ -110,17 +99,19 @@ void AnimLorenzOscFade::_process(double dt) {
   double a = speed/max_speed;
   a = lin_scale(a*a,  0.0, 1.0, 25.0, 150.0);
 
-  int i_r = lin_scale(x, min_x, max_x, 0, N-1);
+  // the range is empty until the oscillator has moved, and infinite once it has diverged.
+  // The index would be NaN, so use the centre LED.
+  int i_r = (max_x > min_x && isfinite(max_x - min_x)) ? lin_scale(x, min_x, max_x, 0, N-1) : N/2;
   double l_x = lin_scale(fabs(dx), 0.0, max_dx, 0.05, c_l);
   // set_pixel_hsl_blend
   // set_pixel_mhroth_hsl_blend
   _pixbuf->set_pixel_mhroth_hsl_blend(i_r, c_h, c_s, l_x, alpha_mult*dt, PixelBuffer::BlendMode::ACCUMULATE);
 
-  int i_g = lin_scale(y, min_y, max_y, 0, N-1);
+  int i_g = (max_y > min_y && isfinite(max_y - min_y)) ? lin_scale(y, min_y, max_y, 0, N-1) : N/2;
   double l_y = lin_scale(fabs(dy), 0.0, max_dy, 0.05, c_l);
   _pixbuf->set_pixel_mhroth_hsl_blend(i_g, c_h+a, c_s, l_y, alpha_mult*dt, PixelBuffer::BlendMode::ACCUMULATE);
 
-  int i_b = lin_scale(z, min_z, max_z, 0, N-1);
+  int i_b = (max_z > min_z && isfinite(max_z - min_z)) ? lin_scale(z, min_z, max_z, 0, N-1) : N/2;
   double l_z = lin_scale(fabs(dz), 0.0, max_dz, 0.05, c_l);
   _pixbuf->set_pixel_mhroth_hsl_blend(i_b, c_h-a, c_s, l_z, alpha_mult*dt, PixelBuffer::BlendMode::ACCUMULATE);
 }
@@ -18,6 +18,7 @@
 #define _ANIM_LORENZ_OSC_FADE_HPP_
 
 #include "Animation.hpp"
+#include "LorenzOscillator.hpp"
 
 class AnimLorenzOscFade: public Animation {
  public:
@@ -32,9 +33,7 @@ class AnimLorenzOscFade: public Animation {
  private:
   void _process(double dt) override;
 
-  double x, y, z, dx, dy, dz;
-  double beta, rho, sigma;
-  double min_x, max_x, min_y, max_y, min_z, max_z;
+  LorenzOscillator osc;
   double max_dx, max_dy, max_dz;
   double max_speed;
   double c_h, c_s, c_l; // base HSL color
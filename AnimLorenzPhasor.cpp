@@ -21,11 +21,12 @@
 #define RESET_PERIOD_SEC 75
 #define FADE_PERIOD_SEC 1
 
-AnimLorenzPhasor::AnimLorenzPhasor(PixelBuffer *pixbuf) : Animation(pixbuf) {
-  m_oscList.reserve(_pixbuf->getNumLeds());
-  for (int i = 0; i < _pixbuf->getNumLeds(); i++) {
-    m_oscList.push_back(LorenzOscillator(10.0, 28, 8.0/3.0));
-  }
+AnimLorenzPhasor::AnimLorenzPhasor(PixelBuffer *pixbuf) : Animation(pixbuf),
+    m_ensemble(pixbuf->getNumLeds(), 10.0f, 28.0f, 8.0f/3.0f) {
+  m_hue = (float *) malloc(pixbuf->getNumLeds() * sizeof(float));
+  m_sat = (float *) malloc(pixbuf->getNumLeds() * sizeof(float));
+  m_light = (float *) malloc(pixbuf->getNumLeds() * sizeof(float));
+  m_tileRange.resize(6 * WorkerPool::getNumTiles(pixbuf->getNumLeds(), ANIMATION_TILE_SIZE));
 
   m_uniform = std::uniform_real_distribution<double>(0.0, 1.0);
   m_tSwitch = 0.0;
@@ -34,12 +35,16 @@ AnimLorenzPhasor::AnimLorenzPhasor(PixelBuffer *pixbuf) : Animation(pixbuf) {
   // m_minGlobalX = INFINITY; m_maxGlobalX = -INFINITY;
   // m_minGlobalY = INFINITY; m_maxGlobalY = -INFINITY;
   // m_minGlobalZ = INFINITY; m_maxGlobalZ = -INFINITY;
-  m_minGlobalX = -21.0; m_maxGlobalX = 21.0; // a good guess on the limits
-  m_minGlobalY = -30.0; m_maxGlobalY = 30.0;
-  m_minGlobalZ = -3.0; m_maxGlobalZ = 50.0;
+  m_minGlobalX = -21.0f; m_maxGlobalX = 21.0f; // a good guess on the limits
+  m_minGlobalY = -30.0f; m_maxGlobalY = 30.0f;
+  m_minGlobalZ = -3.0f; m_maxGlobalZ = 50.0f;
 }
 
-AnimLorenzPhasor::~AnimLorenzPhasor() {}
+AnimLorenzPhasor::~AnimLorenzPhasor() {
+  free(m_hue);
+  free(m_sat);
+  free(m_light);
+}
 
 void AnimLorenzPhasor::setParameter(int index, float value) {
   m_timeDilation = log_scale(value, -1.0f, 1.0f);
@@ -61,9 +66,9 @@ void AnimLorenzPhasor::_process(double dt) {
     double y = cos(el) * sin(az);
     double z = sin(el);
 
-    // double rho = m_oscList[0].getRho();
-    // double beta = m_oscList[0].getBeta();
-    // double sigma = m_oscList[0].getSigma();
+    // double rho = m_ensemble.getRho();
+    // double beta = m_ensemble.getBeta();
+    // double sigma = m_ensemble.getSigma();
     //
     // // determine attractor point
     // double xa = sqrt(beta * (rho  -1.0));
@@ -71,10 +76,10 @@ void AnimLorenzPhasor::_process(double dt) {
     // double za = rho - 1.0;
 
     double r = 1.0; // r ranges from [1,3]
-    const int N = m_oscList.size();
+    const int N = m_ensemble.getNumOscillators();
     for (int i = 0; i < N; i++) {
       r += 2.0/N;
-      m_oscList[i].setPosition(r*x, r*y, r*z);
+      m_ensemble.setPosition(i, r*x, r*y, r*z);
     }
 
     m_lowColour =  m_uniform(_gen) * 360;
@@ -87,28 +92,39 @@ void AnimLorenzPhasor::_process(double dt) {
 
   dt *= m_timeDilation;
 
-  const int NUM_LEDS = _pixbuf->getNumLeds();
-  double x, y, z;
-  double minX, maxX, minY, maxY, minZ, maxZ;
-  for (int i = 0; i < NUM_LEDS; i++) {
-    m_oscList[i].process(dt, &x, &y, &z);
-
-    m_minGlobalX = fmin(m_minGlobalX, x); m_maxGlobalX = fmax(m_maxGlobalX, x);
-    m_minGlobalY = fmin(m_minGlobalY, y); m_maxGlobalY = fmax(m_maxGlobalY, y);
-    m_minGlobalZ = fmin(m_minGlobalZ, z); m_maxGlobalZ = fmax(m_maxGlobalZ, z);
-
-    // NOTE:(mhroth) constants are to prevent case of minX == maxX
-    // x = lin_scale(x, 0.99*m_minGlobalX, 1.01*m_maxGlobalX, m_lowColour, m_lowColour+60);
-    // x = lin_scale(x, 0.99*m_minGlobalX, 1.01*m_maxGlobalX, m_lowColour, m_lowColour+90);
-    // y = lin_scale(y, 0.99*m_minGlobalY, 1.01*m_maxGlobalY);
-    // z = lin_scale(z, 0.99*m_minGlobalZ, 1.01*m_maxGlobalZ);
-    x = lin_scale(x, m_minGlobalX, m_maxGlobalX, m_lowColour, m_lowColour+90);
-    y = lin_scale(y, m_minGlobalY, m_maxGlobalY);
-    z = lin_scale(z, m_minGlobalZ, m_maxGlobalZ);
-
-    _pixbuf->set_pixel_mhroth_hsl_blend(i, x, y, z);
+  // step the oscillators, then reduce the range over all tiles
+  _parallelFor([&](int tile, int begin, int end) {
+    float *const range = m_tileRange.data() + 6*tile;
+    m_ensemble.process((float) dt, begin, end, range, range+3);
+  });
+  for (size_t k = 0; k < m_tileRange.size(); k+=6) {
+    const float *const range = m_tileRange.data() + k;
+    m_minGlobalX = fminf(m_minGlobalX, range[0]); m_maxGlobalX = fmaxf(m_maxGlobalX, range[3]);
+    m_minGlobalY = fminf(m_minGlobalY, range[1]); m_maxGlobalY = fmaxf(m_maxGlobalY, range[4]);
+    m_minGlobalZ = fminf(m_minGlobalZ, range[2]); m_maxGlobalZ = fmaxf(m_maxGlobalZ, range[5]);
   }
 
+  // NOTE:(mhroth) constants are to prevent case of minX == maxX
+  // x = lin_scale(x, 0.99*m_minGlobalX, 1.01*m_maxGlobalX, m_lowColour, m_lowColour+60);
+  // x = lin_scale(x, 0.99*m_minGlobalX, 1.01*m_maxGlobalX, m_lowColour, m_lowColour+90);
+  // y = lin_scale(y, 0.99*m_minGlobalY, 1.01*m_maxGlobalY);
+  // z = lin_scale(z, 0.99*m_minGlobalZ, 1.01*m_maxGlobalZ);
+  // lin_scale() from the global range, folded into one multiply per channel
+  const float kx = 90.0f / (m_maxGlobalX - m_minGlobalX);
+  const float ky = 1.0f / (m_maxGlobalY - m_minGlobalY);
+  const float kz = 1.0f / (m_maxGlobalZ - m_minGlobalZ);
+  const float *x = m_ensemble.getX();
+  const float *y = m_ensemble.getY();
+  const float *z = m_ensemble.getZ();
+  _parallelFor([&](int /*tile*/, int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      m_hue[i] = m_lowColour + (x[i] - m_minGlobalX) * kx;
+      m_sat[i] = (y[i] - m_minGlobalY) * ky;
+      m_light[i] = (z[i] - m_minGlobalZ) * kz;
+    }
+    _pixbuf->set_span_mhroth_hsl_blend(begin, end-begin, m_hue+begin, m_sat+begin, m_light+begin);
+  });
+
   double tt = m_tSwitch - _t;
   if (tt < FADE_PERIOD_SEC) {
     float gain = sinf(M_PI_2*(tt/FADE_PERIOD_SEC)); // fade out
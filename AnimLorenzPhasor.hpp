@@ -20,7 +20,7 @@
 #include <vector>
 
 #include "Animation.hpp"
-#include "LorenzOscillator.hpp"
+#include "LorenzEnsemble.hpp"
 
 class AnimLorenzPhasor: public Animation {
  public:
@@ -35,7 +35,8 @@ class AnimLorenzPhasor: public Animation {
  private:
   void _process(double dt) override;
 
-  std::vector<LorenzOscillator> m_oscList;
+  LorenzEnsemble m_ensemble;
+  std::vector<float> m_tileRange; // the min and max {x, y, z} of each tile in the last frame
 
   std::uniform_real_distribution<double> m_uniform;
 
@@ -43,9 +44,14 @@ class AnimLorenzPhasor: public Animation {
   float m_lowColour;
   float m_timeDilation;
 
-  double m_minGlobalX, m_maxGlobalX;
-  double m_minGlobalY, m_maxGlobalY;
-  double m_minGlobalZ, m_maxGlobalZ;
+  float m_minGlobalX, m_maxGlobalX;
+  float m_minGlobalY, m_maxGlobalY;
+  float m_minGlobalZ, m_maxGlobalZ;
+
+  // per-LED HSL values, written by _process() and passed to the pixel buffer as one span
+  float *m_hue;
+  float *m_sat;
+  float *m_light;
 };
 
 #endif // _ANIM_LORENZ_PHASOR_HPP_
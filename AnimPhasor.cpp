@@ -32,10 +32,18 @@ AnimPhasor::AnimPhasor(PixelBuffer *pixbuf) : Animation(pixbuf) {
 
   mPhase = (float *) malloc(pixbuf->getNumLeds() * sizeof(float));
   memset(mPhase, 0, pixbuf->getNumLeds() * sizeof(float));
+
+  mHue = (float *) malloc(pixbuf->getNumLeds() * sizeof(float));
+  mSat = (float *) malloc(pixbuf->getNumLeds() * sizeof(float));
+  mLight = (float *) malloc(pixbuf->getNumLeds() * sizeof(float));
+  for (int i = 0; i < pixbuf->getNumLeds(); ++i) mSat[i] = 0.8f;
 }
 
 AnimPhasor::~AnimPhasor() {
   free(mPhase);
+  free(mHue);
+  free(mSat);
+  free(mLight);
 }
 
 void AnimPhasor::setParameter(int index, float value) {
@@ -71,13 +79,15 @@ void AnimPhasor::_process(double dt) {
   float fMax = lin_scale(x, 0, 1, mFMaxPrev, mFMaxNext);
   float hue = lin_scale(x, 0, 1, mHuePrev, mHueNext);
 
-  const int N = _pixbuf->getNumLeds();
-  const float n = (float) N;
-  for (int i = 0; i < N; ++i) {
-    float f = lin_scale(i, 0, n, mFMin, fMax);
-    mPhase[i] += f * dt;
-    float y = fabsf(sinf(2.0f * M_PI * mPhase[i]));
-    float h = (y >= 0.5f) ? hue : hue+mHueOffset;
-    _pixbuf->set_pixel_mhroth_hsl_blend(i, h, 0.8f, 0.8f*y);
-  }
+  const float n = (float) _pixbuf->getNumLeds();
+  _parallelFor([&](int /*tile*/, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      float f = lin_scale(i, 0, n, mFMin, fMax);
+      mPhase[i] += f * dt;
+      float y = fabsf(sinf(2.0f * M_PI * mPhase[i]));
+      mHue[i] = (y >= 0.5f) ? hue : hue+mHueOffset;
+      mLight[i] = 0.8f*y;
+    }
+    _pixbuf->set_span_mhroth_hsl_blend(begin, end-begin, mHue+begin, mSat+begin, mLight+begin);
+  });
 }
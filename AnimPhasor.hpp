@@ -46,6 +46,11 @@ class AnimPhasor: public Animation {
   float mHueOffset;
 
   float* mPhase;
+
+  // per-LED HSL values, written by _process() and passed to the pixel buffer as one span
+  float* mHue;
+  float* mSat;
+  float* mLight;
 };
 
 #endif // _ANIM_PHASOR_HPP_
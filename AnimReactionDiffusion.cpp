@@ -0,0 +1,203 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <utility>
+
+#include "AnimReactionDiffusion.hpp"
+#include "tiny_simd.h"
+
+#define RD_MAX_ROWS 64 // only the middle row is shown, so the grid need not grow with the strip
+#define RD_MIN_ROWS 4
+#define RD_ROWS_PER_BAND 8 // rows per tile on the worker pool, a multiple of 4
+#define RD_MAX_STEP 1.0f // explicit Euler is stable below 1/(4*max(r_u, r_v))
+#define RD_DEFAULT_SPEED 120.0f // simulation time per second, i.e. two steps per frame at 60 fps
+#define RD_V_EPSILON 1e-6f // smaller concentrations of v are flushed to zero, before they become denormal
+
+// float f = 0.026f;
+// float k = 0.049f;
+// float r_u = 0.2097f;
+// float r_v = 0.105f;
+
+// float f = 0.012f;
+// float k = 0.05f;
+// float r_u = 0.01f;
+// float r_v = 0.005f;
+
+// float f = 0.023f;
+// float k = 0.074f;
+// float r_u = 0.095f;
+// float r_v = 0.03f;
+
+// The default. From the seed, it grows a pattern across the whole middle row (the one that is
+// shown) within a few minutes, which then holds its contrast. With the sets above, the row turns
+// dark or one uniform colour.
+#define RD_F 0.062f
+#define RD_K 0.062f
+#define RD_R_U 0.19f
+#define RD_R_V 0.09f
+
+AnimReactionDiffusion::AnimReactionDiffusion(PixelBuffer *pixbuf) : Animation(pixbuf) {
+  m_width = _pixbuf->getNumLeds();
+  m_height = m_width/2;
+  if (m_height > RD_MAX_ROWS) m_height = RD_MAX_ROWS;
+  if (m_height < RD_MIN_ROWS) m_height = RD_MIN_ROWS;
+
+  // the last group of 4 cells in a row may reach 3 cells past the interior, plus one for the stencil
+  m_stride = (m_width + 5 + 3) & ~0x3;
+  for (int k = 0; k < 2; ++k) {
+    m_u[k] = (float *) calloc((m_height+2) * m_stride, sizeof(float));
+    m_v[k] = (float *) calloc((m_height+2) * m_stride, sizeof(float));
+    assert(m_u[k] != nullptr && m_v[k] != nullptr);
+  }
+
+  for (int y = 0; y < m_height; y++) {
+    float *const u = m_u[0] + (y+1)*m_stride + 1;
+    float *const v = m_v[0] + (y+1)*m_stride + 1;
+    for (int x = 0; x < m_width; x++) {
+      const bool isSeed = (x >= m_width/3 && x < 2*m_width/3 && y >= m_height/3 && y < 2*m_height/3);
+      u[x] = isSeed ? 0.33f : 1.0f;
+      v[x] = isSeed ? 0.67f : 0.0f;
+    }
+  }
+
+  m_speed = RD_DEFAULT_SPEED;
+
+  m_hue = (float *) malloc(m_width * sizeof(float));
+  m_sat = (float *) malloc(m_width * sizeof(float));
+  m_light = (float *) malloc(m_width * sizeof(float));
+  for (int i = 0; i < m_width; i++) {
+    m_hue[i] = 266.4f;
+    m_sat[i] = 0.87f;
+  }
+}
+
+AnimReactionDiffusion::~AnimReactionDiffusion() {
+  for (int k = 0; k < 2; ++k) {
+    free(m_u[k]);
+    free(m_v[k]);
+  }
+  free(m_hue);
+  free(m_sat);
+  free(m_light);
+}
+
+void AnimReactionDiffusion::setParameter(int index, float value) {
+  switch (index) {
+    case 0: m_speed = log_scale(value, 1.0f, 2.5f); break;
+    default: break;
+  }
+}
+
+float AnimReactionDiffusion::getParameter(int index) {
+  switch (index) {
+    case 0: return m_speed;
+    default: return -1.0f;
+  }
+}
+
+void AnimReactionDiffusion::__fill_halo(float *grid) {
+  for (int y = 1; y <= m_height; y++) {
+    float *const row = grid + y*m_stride;
+    row[0] = row[m_width];
+    row[m_width+1] = row[1];
+  }
+  memcpy(grid, grid + m_height*m_stride, m_stride*sizeof(float));
+  memcpy(grid + (m_height+1)*m_stride, grid + m_stride, m_stride*sizeof(float));
+}
+
+void AnimReactionDiffusion::__step_rows(int begin, int end, float h) {
+  const tsimd_f32x4 ZERO = tsimd_dup_f32(0.0f);
+  const tsimd_f32x4 ONE = tsimd_dup_f32(1.0f);
+  const tsimd_f32x4 FOUR = tsimd_dup_f32(4.0f);
+  const tsimd_f32x4 H = tsimd_dup_f32(h);
+  const tsimd_f32x4 NEG_H = tsimd_dup_f32(-h);
+  const tsimd_f32x4 HRU = tsimd_dup_f32(h*RD_R_U);
+  const tsimd_f32x4 HRV = tsimd_dup_f32(h*RD_R_V);
+  const tsimd_f32x4 HF = tsimd_dup_f32(h*RD_F);
+  const tsimd_f32x4 NEG_HFK = tsimd_dup_f32(-h*(RD_F+RD_K));
+  const tsimd_f32x4 V_EPSILON = tsimd_dup_f32(RD_V_EPSILON);
+  const int S = m_stride;
+
+  // process diffusion
+  // https://groups.csail.mit.edu/mac/projects/amorphous/GrayScott/
+  // https://www.uni-muenster.de/imperia/md/content/physik_tp/lectures/ws2016-2017/num_methods_i/rd.pdf
+  for (int y = begin; y < end; y++) {
+    const int j = (y+1)*S + 1;
+    const float *const u0 = m_u[0] + j;
+    const float *const v0 = m_v[0] + j;
+    float *const u1 = m_u[1] + j;
+    float *const v1 = m_v[1] + j;
+    for (int x = 0; x < m_width; x+=4) {
+      const tsimd_f32x4 u = tsimd_load_f32(u0+x);
+      const tsimd_f32x4 v = tsimd_load_f32(v0+x);
+
+      // 5-point Laplacian
+      tsimd_f32x4 lu = tsimd_add_f32(tsimd_add_f32(tsimd_load_f32(u0+x-1), tsimd_load_f32(u0+x+1)),
+          tsimd_add_f32(tsimd_load_f32(u0+x-S), tsimd_load_f32(u0+x+S)));
+      tsimd_f32x4 lv = tsimd_add_f32(tsimd_add_f32(tsimd_load_f32(v0+x-1), tsimd_load_f32(v0+x+1)),
+          tsimd_add_f32(tsimd_load_f32(v0+x-S), tsimd_load_f32(v0+x+S)));
+      lu = tsimd_sub_f32(lu, tsimd_mul_f32(FOUR, u));
+      lv = tsimd_sub_f32(lv, tsimd_mul_f32(FOUR, v));
+
+      // du = r_u*lu - u*v*v + f*(1-u)
+      // dv = r_v*lv + u*v*v - (f+k)*v
+      const tsimd_f32x4 uvv = tsimd_mul_f32(u, tsimd_mul_f32(v, v));
+      tsimd_f32x4 un = tsimd_madd_f32(u, HRU, lu);
+      un = tsimd_madd_f32(un, NEG_H, uvv);
+      un = tsimd_madd_f32(un, HF, tsimd_sub_f32(ONE, u));
+      tsimd_f32x4 vn = tsimd_madd_f32(v, HRV, lv);
+      vn = tsimd_madd_f32(vn, H, uvv);
+      vn = tsimd_madd_f32(vn, NEG_HFK, v);
+
+      // clamping v to 1-u, as before, starves the reaction and the pattern dies out within seconds
+      un = tsimd_min_f32(ONE, tsimd_max_f32(ZERO, un));
+      vn = tsimd_min_f32(ONE, tsimd_max_f32(ZERO, vn));
+      vn = tsimd_select_f32(tsimd_lt_f32(vn, V_EPSILON), ZERO, vn);
+      tsimd_store_f32(u1+x, un);
+      tsimd_store_f32(v1+x, vn);
+    }
+  }
+}
+
+void AnimReactionDiffusion::_process(double dt) {
+  const float t = m_speed * (float) dt;
+  const int numSteps = (int) ceilf(t / RD_MAX_STEP);
+  const float h = (numSteps > 0) ? t / numSteps : 0.0f;
+  for (int k = 0; k < numSteps; ++k) {
+    __fill_halo(m_u[0]);
+    __fill_halo(m_v[0]);
+    _parallelFor(m_height, RD_ROWS_PER_BAND, [&](int /*tile*/, int begin, int end) {
+      __step_rows(begin, end, h);
+    });
+
+    // switch to next grid
+    std::swap(m_u[0], m_u[1]);
+    std::swap(m_v[0], m_v[1]);
+  }
+
+  // scan the grid along the middle row
+  const float row = m_height / 2.0f;
+  const float row_floor = floorf(row);
+  const int row_low = (int) row_floor;
+  const int row_high = (row_low+1) % m_height;
+  const float frac = row - row_floor;
+  const float *const v_low = m_v[0] + (row_low+1)*m_stride + 1;
+  const float *const v_high = m_v[0] + (row_high+1)*m_stride + 1;
+  for (int i = 0; i < m_width; i++) {
+    m_light[i] = v_low[i] + frac*(v_high[i]-v_low[i]);
+  }
+  _pixbuf->set_span_hsl_blend(0, m_width, m_hue, m_sat, m_light);
+}
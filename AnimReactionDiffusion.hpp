@@ -0,0 +1,64 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _ANIM_REACTION_DIFFUSION_HPP_
+#define _ANIM_REACTION_DIFFUSION_HPP_
+
+#include "Animation.hpp"
+
+/**
+ * A Gray-Scott reaction-diffusion system on a periodic grid, one column per LED.
+ * The strip shows the concentration of v along the middle row.
+ *
+ * Each grid is stored row-major with a one cell halo, which is refreshed from the
+ * opposite edge before each step, so that the stencil needs no wraparound. Rows are
+ * stepped four cells at a time with tiny_simd, in bands of rows on the worker pool.
+ */
+class AnimReactionDiffusion: public Animation {
+ public:
+  AnimReactionDiffusion(PixelBuffer *pixbuf);
+  ~AnimReactionDiffusion();
+
+  void setParameter(int index, float value) override;
+  float getParameter(int index) override;
+
+  const char *getName() override { return "Reaction Diffusion"; }
+
+ private:
+  void _process(double dt) override;
+
+  // copies the opposite edges of the interior into the halo of grid
+  void __fill_halo(float *grid);
+
+  // steps the interior rows [begin,end) by h, from the current into the next grids
+  void __step_rows(int begin, int end, float h);
+
+  int m_width;  // interior cells per row, one per LED
+  int m_height; // interior rows
+  int m_stride; // floats per row, including the halo and padding
+
+  float *m_u[2]; // current and next grid
+  float *m_v[2];
+
+  float m_speed; // simulation time per second
+
+  // per-LED HSL values of the scanned row
+  float *m_hue;
+  float *m_sat;
+  float *m_light;
+};
+
+#endif // _ANIM_REACTION_DIFFUSION_HPP_
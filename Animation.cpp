@@ -18,10 +18,21 @@
 
 #include "Animation.hpp"
 
+static uint64_t __random_seed = 0; // see Animation::setRandomSeed()
+
 Animation::Animation(PixelBuffer *pixbuf) :
     _pixbuf(pixbuf), _step(0), _t(0.0) {
   assert(pixbuf != nullptr);
-  _gen = std::default_random_engine(std::chrono::system_clock::now().time_since_epoch().count());
+  _gen.seed((__random_seed != 0) ? __random_seed
+      : (uint64_t) std::chrono::system_clock::now().time_since_epoch().count());
+
+  // the tiles' streams depend only on the seed, not on the number of threads
+  const int numTiles = WorkerPool::getNumTiles(pixbuf->getNumLeds(), ANIMATION_TILE_SIZE);
+  for (int k = 0; k < numTiles; ++k) {
+    const uint64_t hi = _gen();
+    _tileGen.push_back(Random((hi << 32) | _gen()));
+  }
+  _pool = nullptr;
 
   _t = 0.0;
 
@@ -30,6 +41,10 @@ Animation::Animation(PixelBuffer *pixbuf) :
   getDatetimeUtc();
 }
 
+void Animation::setRandomSeed(uint64_t seed) {
+  __random_seed = seed;
+}
+
 double Animation::lin_scale(double x, double min_in, double max_in, double min_out, double max_out) {
   return ((x-min_in)/(max_in-min_in))*(max_out-min_out) + min_out;
 }
@@ -26,12 +26,18 @@
 #include <time.h>
 
 #include <random>
+#include <vector>
 
 #include "PixelBuffer.hpp"
+#include "Random.hpp"
+#include "WorkerPool.hpp"
 
 #define M_TAU 6.283185307179586f
 #define M_SQRT_TAU 2.506628274631001f // sqrt(2*pi)
 
+// the number of LEDs per tile of _parallelFor(), a multiple of 4
+#define ANIMATION_TILE_SIZE 64
+
 class Animation {
  public:
   Animation(PixelBuffer *pixbuf);
@@ -67,6 +73,18 @@ class Animation {
    */
   virtual double getPreferredFps() { return -1.0; }
 
+  /**
+   * Sets the pool that _parallelFor() runs on. Not owned. Without a pool, all tiles
+   * run on the calling thread.
+   */
+  void setWorkerPool(WorkerPool *pool) { _pool = pool; }
+
+  /**
+   * Seeds the random number generators of all animations created from now on, so that
+   * runs can be reproduced. A seed of 0 (the default) seeds them from the clock.
+   */
+  static void setRandomSeed(uint64_t seed);
+
   /** Linear scaling. */
   double lin_scale(double x, double min_in, double max_in, double min_out=0.0, double max_out=1.0);
 
@@ -103,6 +121,31 @@ class Animation {
    */
   float pdf_logNormal(float x, float mu, float sigma);
 
+  /**
+   * Calls f(tile, begin, end) for each tile of ANIMATION_TILE_SIZE LEDs of the strip,
+   * in parallel if there is a worker pool. See WorkerPool::parallelFor().
+   *
+   * f may only write the LEDs in [begin,end) (e.g. as one span), and must use
+   * _tileGen[tile] rather than _gen for random numbers.
+   */
+  template <typename F>
+  void _parallelFor(const F &f) {
+    _parallelFor(_pixbuf->getNumLeds(), ANIMATION_TILE_SIZE, f);
+  }
+
+  /** As above, over tiles of tileSize (a multiple of 4) of [0,n), e.g. rows of a grid. */
+  template <typename F>
+  void _parallelFor(int n, int tileSize, const F &f) {
+    if (_pool != nullptr) {
+      _pool->parallelFor(n, tileSize, f);
+    } else {
+      const int numTiles = WorkerPool::getNumTiles(n, tileSize);
+      for (int k = 0; k < numTiles; ++k) {
+        f(k, k*tileSize, (k+1 < numTiles) ? (k+1)*tileSize : n);
+      }
+    }
+  }
+
   /** The number of frames processed so far by this animation. */
   uint32_t _step;
 
@@ -112,8 +155,17 @@ class Animation {
   /** The total elapsed time in seconds in this animation. */
   double _t;
 
-  /** A random number generator. */
-  std::default_random_engine _gen;
+  /**
+   * A random number generator. Works with the std distributions, but arrays of samples
+   * are much cheaper to draw with Random::uniform(), normal() and exponential().
+   */
+  Random _gen;
+
+  /** A random number generator per tile of _parallelFor(), seeded from _gen. */
+  std::vector<Random> _tileGen;
+
+  /** The pool that _parallelFor() runs on, or null. */
+  WorkerPool *_pool;
 
  private:
   struct tm mCurrentDatetime; // current datetime
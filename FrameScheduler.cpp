@@ -0,0 +1,144 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "FrameScheduler.hpp"
+
+#define SEC_TO_NS 1000000000ULL
+
+// LOWER policy: the frame rate drops by this factor after this many overruns in a row,
+// and recovers by the same factor after a second's worth of frames on time.
+#define LOWER_FACTOR 0.8
+#define LOWER_AFTER_OVERRUNS 4
+#define LOWER_MIN_FPS 1.0
+
+static uint64_t __now_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((uint64_t) t.tv_sec) * SEC_TO_NS + (uint64_t) t.tv_nsec;
+}
+
+static void __sleep_until_ns(uint64_t ns) {
+  struct timespec t;
+  t.tv_sec = (time_t) (ns / SEC_TO_NS);
+  t.tv_nsec = (long) (ns % SEC_TO_NS);
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR);
+}
+
+FrameScheduler::FrameScheduler(double fps, OverrunPolicy policy) {
+  m_policy = policy;
+  m_numOverruns = 0;
+  m_lastNs = __now_ns();
+  setFps(fps);
+}
+
+void FrameScheduler::__setPeriod(double fps) {
+  m_fps = fps;
+  m_periodNs = (fps > 0.0) ? (uint64_t) (SEC_TO_NS/fps) : 0;
+}
+
+void FrameScheduler::setFps(double fps) {
+  m_targetFps = fps;
+  __setPeriod(fps);
+  m_restart = true;
+  m_numLateInARow = 0;
+  m_numOnTimeInARow = 0;
+}
+
+double FrameScheduler::waitForNextFrame() {
+  uint64_t now = __now_ns();
+
+  if (m_periodNs == 0) {
+    // as fast as possible
+    const double dt = (now - m_lastNs) / (double) SEC_TO_NS;
+    m_lastNs = now;
+    return dt;
+  }
+
+  if (m_restart) {
+    // the first frame of a new grid
+    m_restart = false;
+    m_deadlineNs = now;
+  }
+
+  uint64_t next = m_deadlineNs + m_periodNs;
+  if (now <= next) {
+    m_numLateInARow = 0;
+    if (m_policy == LOWER && m_fps < m_targetFps && ++m_numOnTimeInARow >= (uint32_t) m_fps) {
+      m_numOnTimeInARow = 0;
+      __setPeriod(fmin(m_targetFps, m_fps/LOWER_FACTOR));
+      next = m_deadlineNs + m_periodNs;
+    }
+  } else {
+    ++m_numOverruns;
+    m_numOnTimeInARow = 0;
+    switch (m_policy) {
+      case DROP: {
+        // the first grid slot that is still in the future
+        next += ((now - next) / m_periodNs + 1) * m_periodNs;
+        break;
+      }
+      case LOWER: {
+        if (++m_numLateInARow >= LOWER_AFTER_OVERRUNS) {
+          m_numLateInARow = 0;
+          __setPeriod(fmax(LOWER_MIN_FPS, m_fps*LOWER_FACTOR));
+        }
+        next = now; // as STRETCH
+        break;
+      }
+      default:
+      case STRETCH: next = now; break;
+    }
+  }
+
+  if (next > now) __sleep_until_ns(next);
+  const double dt = (next - m_deadlineNs) / (double) SEC_TO_NS;
+  m_deadlineNs = next;
+  m_lastNs = next;
+  return dt;
+}
+
+bool FrameScheduler::parsePolicy(const char *name, OverrunPolicy *policy) {
+  if (!strcmp(name, "drop")) *policy = DROP;
+  else if (!strcmp(name, "stretch")) *policy = STRETCH;
+  else if (!strcmp(name, "lower")) *policy = LOWER;
+  else return false;
+  return true;
+}
+
+bool FrameScheduler::setRealtime(int priority) {
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = priority;
+  int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if (ret != 0) printf("Could not set SCHED_FIFO priority %i: %s\n", priority, strerror(ret));
+  return (ret == 0);
+}
+
+bool FrameScheduler::pinToCpu(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+  if (ret != 0) printf("Could not pin to CPU %i: %s\n", cpu, strerror(ret));
+  return (ret == 0);
+}
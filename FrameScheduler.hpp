@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _FRAME_SCHEDULER_HPP_
+#define _FRAME_SCHEDULER_HPP_
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Paces the render loop on a fixed grid of frame deadlines. Sleeps use absolute
+ * deadlines (clock_nanosleep with TIMER_ABSTIME), so that oversleeping in one frame
+ * does not shift all following frames.
+ *
+ * When a frame takes longer than its period (an overrun), the policy decides what happens:
+ *
+ *   DROP     stay on the grid and skip the missed slots. dt covers the skipped slots.
+ *   STRETCH  start a new grid at the late frame. dt is the measured frame time.
+ *   LOWER    as STRETCH, but lower the frame rate after repeated overruns, and
+ *            raise it back towards the target once frames are on time again.
+ */
+class FrameScheduler {
+ public:
+  enum OverrunPolicy {
+    DROP,
+    STRETCH,
+    LOWER,
+  };
+
+  /**
+   * @param fps  The target frame rate. A non-positive number means as fast as possible.
+   */
+  FrameScheduler(double fps, OverrunPolicy policy=STRETCH);
+
+  /** Sets a new target frame rate and restarts the grid at the next frame. */
+  void setFps(double fps);
+
+  /** The current frame rate, which may be below the target under the LOWER policy. */
+  double getFps() const { return m_fps; }
+
+  bool isUnlimited() const { return m_targetFps <= 0.0; }
+
+  /**
+   * Waits until the deadline of the next frame.
+   *
+   * @return  The time step for the next frame, in seconds.
+   */
+  double waitForNextFrame();
+
+  /** The number of frames that missed their deadline. */
+  uint32_t getNumOverruns() const { return m_numOverruns; }
+
+  /** Parses "drop", "stretch" or "lower". Returns false if the name is unknown. */
+  static bool parsePolicy(const char *name, OverrunPolicy *policy);
+
+  /** Runs the calling thread with SCHED_FIFO at the given priority. Needs CAP_SYS_NICE. */
+  static bool setRealtime(int priority);
+
+  /** Pins the calling thread to the given CPU. */
+  static bool pinToCpu(int cpu);
+
+ private:
+  void __setPeriod(double fps);
+
+  OverrunPolicy m_policy;
+  double m_targetFps;
+  double m_fps;
+  uint64_t m_periodNs;
+
+  /** The deadline of the current frame, and the time that waitForNextFrame() last returned. */
+  uint64_t m_deadlineNs;
+  uint64_t m_lastNs;
+  bool m_restart;
+
+  uint32_t m_numOverruns;
+  uint32_t m_numLateInARow;
+  uint32_t m_numOnTimeInARow;
+};
+
+#endif // _FRAME_SCHEDULER_HPP_
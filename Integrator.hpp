@@ -0,0 +1,194 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _INTEGRATOR_HPP_
+#define _INTEGRATOR_HPP_
+
+#include <assert.h>
+#include <math.h>
+
+/**
+ * Advances an N-dimensional ODE system, ds/dt = f(s), by one frame.
+ *
+ * The system is any functor with the signature
+ *   void operator()(const double *s, double *ds) const;
+ * which writes the derivative at state s into ds. process() is templated on
+ * it, so the derivative is inlined into the integration loop of each system.
+ *
+ * A frame of length dt is split into steps of at most maxStep, so that long
+ * frames (low frame rates, underruns) do not make a system blow up.
+ *
+ *   EULER  forward Euler, in equal substeps of at most maxStep. One evaluation per substep.
+ *   RK4    classic 4th-order Runge-Kutta, in equal substeps of at most maxStep. Four
+ *          evaluations per substep.
+ *   RK45   adaptive Dormand-Prince 5(4). The step size is chosen to keep the local error
+ *          below the tolerance, never exceeds maxStep, and is carried over to the next frame.
+ *          Six evaluations per accepted step, plus any rejected steps.
+ */
+template <int N>
+class Integrator {
+ public:
+  enum Method {
+    EULER,
+    RK4,
+    RK45,
+  };
+
+  /**
+   * @param maxStep  The longest step taken, in seconds.
+   * @param tolerance  The error tolerance of RK45, relative to the magnitude of the state.
+   */
+  Integrator(Method method=RK4, double maxStep=0.01, double tolerance=1e-6) {
+    setMethod(method);
+    setMaxStep(maxStep);
+    setTolerance(tolerance);
+    m_numEvaluations = 0;
+  }
+
+  void setMethod(Method method) { m_method = method; }
+  Method getMethod() const { return m_method; }
+
+  void setMaxStep(double maxStep) {
+    assert(maxStep > 0.0);
+    m_maxStep = maxStep;
+    m_h = maxStep;
+  }
+  double getMaxStep() const { return m_maxStep; }
+
+  void setTolerance(double tolerance) {
+    assert(tolerance > 0.0);
+    m_tolerance = tolerance;
+  }
+  double getTolerance() const { return m_tolerance; }
+
+  /** The number of derivative evaluations made by the last call to process(). */
+  int getNumEvaluations() const { return m_numEvaluations; }
+
+  /** Advances the state s by dt seconds. */
+  template <typename System>
+  void process(const System &f, double *s, double dt) {
+    m_numEvaluations = 0;
+    if (dt <= 0.0) return;
+
+    switch (m_method) {
+      case EULER: {
+        const int n = __num_substeps(dt);
+        const double h = dt / n;
+        double ds[N];
+        for (int k = 0; k < n; ++k) {
+          f(s, ds);
+          for (int i = 0; i < N; ++i) s[i] += h * ds[i];
+        }
+        m_numEvaluations = n;
+        break;
+      }
+      case RK4: {
+        const int n = __num_substeps(dt);
+        const double h = dt / n;
+        for (int k = 0; k < n; ++k) __rk4_step(f, s, h);
+        m_numEvaluations = 4*n;
+        break;
+      }
+      case RK45: __rk45(f, s, dt); break;
+      default: assert(false); break;
+    }
+  }
+
+ private:
+  int __num_substeps(double dt) const {
+    return (int) ceil(dt / m_maxStep);
+  }
+
+  template <typename System>
+  static void __rk4_step(const System &f, double *s, double h) {
+    double k1[N], k2[N], k3[N], k4[N], t[N];
+    f(s, k1);
+    for (int i = 0; i < N; ++i) t[i] = s[i] + 0.5*h*k1[i];
+    f(t, k2);
+    for (int i = 0; i < N; ++i) t[i] = s[i] + 0.5*h*k2[i];
+    f(t, k3);
+    for (int i = 0; i < N; ++i) t[i] = s[i] + h*k3[i];
+    f(t, k4);
+    for (int i = 0; i < N; ++i) s[i] += (h/6.0) * (k1[i] + 2.0*k2[i] + 2.0*k3[i] + k4[i]);
+  }
+
+  // https://en.wikipedia.org/wiki/Dormand%E2%80%93Prince_method
+  template <typename System>
+  void __rk45(const System &f, double *s, double dt) {
+    double k1[N], k2[N], k3[N], k4[N], k5[N], k6[N], k7[N], t[N];
+
+    f(s, k1);
+    int evaluations = 1;
+    double remaining = dt;
+    while (remaining > 0.0) {
+      const bool isLast = (m_h >= remaining);
+      const double h = isLast ? remaining : m_h;
+
+      for (int i = 0; i < N; ++i) t[i] = s[i] + h*(1.0/5.0)*k1[i];
+      f(t, k2);
+      for (int i = 0; i < N; ++i) t[i] = s[i] + h*((3.0/40.0)*k1[i] + (9.0/40.0)*k2[i]);
+      f(t, k3);
+      for (int i = 0; i < N; ++i) t[i] = s[i] + h*((44.0/45.0)*k1[i] - (56.0/15.0)*k2[i]
+          + (32.0/9.0)*k3[i]);
+      f(t, k4);
+      for (int i = 0; i < N; ++i) t[i] = s[i] + h*((19372.0/6561.0)*k1[i] - (25360.0/2187.0)*k2[i]
+          + (64448.0/6561.0)*k3[i] - (212.0/729.0)*k4[i]);
+      f(t, k5);
+      for (int i = 0; i < N; ++i) t[i] = s[i] + h*((9017.0/3168.0)*k1[i] - (355.0/33.0)*k2[i]
+          + (46732.0/5247.0)*k3[i] + (49.0/176.0)*k4[i] - (5103.0/18656.0)*k5[i]);
+      f(t, k6);
+      // the 5th-order solution
+      for (int i = 0; i < N; ++i) t[i] = s[i] + h*((35.0/384.0)*k1[i] + (500.0/1113.0)*k3[i]
+          + (125.0/192.0)*k4[i] - (2187.0/6784.0)*k5[i] + (11.0/84.0)*k6[i]);
+      f(t, k7);
+      evaluations += 6;
+
+      // difference to the embedded 4th-order solution, relative to the tolerance
+      double err = 0.0;
+      for (int i = 0; i < N; ++i) {
+        const double e = h*((71.0/57600.0)*k1[i] - (71.0/16695.0)*k3[i] + (71.0/1920.0)*k4[i]
+            - (17253.0/339200.0)*k5[i] + (22.0/525.0)*k6[i] - (1.0/40.0)*k7[i]);
+        const double scale = m_tolerance * (1.0 + fmax(fabs(s[i]), fabs(t[i])));
+        err = fmax(err, fabs(e) / scale);
+      }
+
+      // accept the step if it is within tolerance, or if the step can't shrink any further
+      const double hMin = 1e-6 * m_maxStep;
+      if (err <= 1.0 || h <= hMin) {
+        for (int i = 0; i < N; ++i) {
+          s[i] = t[i];
+          k1[i] = k7[i]; // first same as last
+        }
+        remaining = isLast ? 0.0 : (remaining - h);
+      }
+
+      // next step size, within a factor of 5 of this one. A shortened last step keeps m_h.
+      const double factor = (err > 0.0) ? fmin(fmax(0.9 * pow(err, -0.2), 0.2), 5.0) : 5.0;
+      if (!isLast || err > 1.0) {
+        m_h = fmin(fmax(h * factor, hMin), m_maxStep);
+      }
+    }
+    m_numEvaluations = evaluations;
+  }
+
+  Method m_method;
+  double m_maxStep;
+  double m_tolerance;
+  double m_h; // the RK45 step size, carried over between frames
+  int m_numEvaluations;
+};
+
+#endif // _INTEGRATOR_HPP_
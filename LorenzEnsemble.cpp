@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "LorenzEnsemble.hpp"
+#include "tiny_simd.h"
+
+LorenzEnsemble::LorenzEnsemble(int numOscillators, float sigma, float rho, float beta) {
+  assert(numOscillators > 0);
+  m_numOscillators = numOscillators;
+  m_sigma = sigma; m_rho = rho; m_beta = beta;
+  m_maxStep = 0.01f;
+
+  m_x = (float *) malloc(numOscillators * sizeof(float));
+  m_y = (float *) malloc(numOscillators * sizeof(float));
+  m_z = (float *) malloc(numOscillators * sizeof(float));
+  assert(m_x != nullptr && m_y != nullptr && m_z != nullptr);
+  memset(m_x, 0, numOscillators * sizeof(float));
+  memset(m_y, 0, numOscillators * sizeof(float));
+  memset(m_z, 0, numOscillators * sizeof(float));
+
+  for (int k = 0; k < 3; ++k) {
+    m_min[k] = 0.0f; m_max[k] = 0.0f;
+  }
+}
+
+LorenzEnsemble::~LorenzEnsemble() {
+  free(m_x);
+  free(m_y);
+  free(m_z);
+}
+
+void LorenzEnsemble::process(float dt) {
+  process(dt, 0, m_numOscillators, m_min, m_max);
+}
+
+void LorenzEnsemble::process(float dt, int begin, int end, float *min, float *max) {
+  assert(begin >= 0 && begin <= end && end <= m_numOscillators);
+  const int N4 = begin + ((end - begin) & ~3);
+  const int numSteps = (dt > 0.0f) ? (int) ceilf(dt / m_maxStep) : 0;
+  dt = (numSteps > 0) ? dt / numSteps : 0.0f;
+
+  const tsimd_f32x4 sigma = tsimd_dup_f32(m_sigma);
+  const tsimd_f32x4 rho = tsimd_dup_f32(m_rho);
+  const tsimd_f32x4 beta = tsimd_dup_f32(m_beta);
+  const tsimd_f32x4 vdt = tsimd_dup_f32(dt);
+
+  tsimd_f32x4 minX = tsimd_dup_f32(INFINITY), maxX = tsimd_dup_f32(-INFINITY);
+  tsimd_f32x4 minY = minX, maxY = maxX;
+  tsimd_f32x4 minZ = minX, maxZ = maxX;
+
+  int i = begin;
+  for (; i < N4; i+=4) {
+    tsimd_f32x4 x = tsimd_load_f32(m_x+i);
+    tsimd_f32x4 y = tsimd_load_f32(m_y+i);
+    tsimd_f32x4 z = tsimd_load_f32(m_z+i);
+
+    // each group of four oscillators takes all of its substeps in registers
+    for (int k = 0; k < numSteps; ++k) {
+      // all derivatives are taken from the previous position
+      tsimd_f32x4 dx = tsimd_mul_f32(sigma, tsimd_sub_f32(y, x));
+      tsimd_f32x4 dy = tsimd_sub_f32(tsimd_mul_f32(x, tsimd_sub_f32(rho, z)), y);
+      tsimd_f32x4 dz = tsimd_sub_f32(tsimd_mul_f32(x, y), tsimd_mul_f32(beta, z));
+
+      x = tsimd_madd_f32(x, dx, vdt);
+      y = tsimd_madd_f32(y, dy, vdt);
+      z = tsimd_madd_f32(z, dz, vdt);
+    }
+
+    tsimd_store_f32(m_x+i, x);
+    tsimd_store_f32(m_y+i, y);
+    tsimd_store_f32(m_z+i, z);
+
+    minX = tsimd_min_f32(minX, x); maxX = tsimd_max_f32(maxX, x);
+    minY = tsimd_min_f32(minY, y); maxY = tsimd_max_f32(maxY, y);
+    minZ = tsimd_min_f32(minZ, z); maxZ = tsimd_max_f32(maxZ, z);
+  }
+
+  // fold the lanes of the reduction
+  float lo[3][4], hi[3][4];
+  tsimd_store_f32(lo[0], minX); tsimd_store_f32(hi[0], maxX);
+  tsimd_store_f32(lo[1], minY); tsimd_store_f32(hi[1], maxY);
+  tsimd_store_f32(lo[2], minZ); tsimd_store_f32(hi[2], maxZ);
+  for (int k = 0; k < 3; ++k) {
+    min[k] = fminf(fminf(lo[k][0], lo[k][1]), fminf(lo[k][2], lo[k][3]));
+    max[k] = fmaxf(fmaxf(hi[k][0], hi[k][1]), fmaxf(hi[k][2], hi[k][3]));
+  }
+
+  // the remaining oscillators, if the range is not a multiple of 4
+  for (; i < end; ++i) {
+    for (int k = 0; k < numSteps; ++k) {
+      const float x = m_x[i], y = m_y[i], z = m_z[i];
+      m_x[i] = x + m_sigma * (y - x) * dt;
+      m_y[i] = y + ((x * (m_rho - z)) - y) * dt;
+      m_z[i] = z + (x*y - m_beta*z) * dt;
+    }
+
+    min[0] = fminf(min[0], m_x[i]); max[0] = fmaxf(max[0], m_x[i]);
+    min[1] = fminf(min[1], m_y[i]); max[1] = fmaxf(max[1], m_y[i]);
+    min[2] = fminf(min[2], m_z[i]); max[2] = fmaxf(max[2], m_z[i]);
+  }
+}
@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _LORENZ_ENSEMBLE_HPP_
+#define _LORENZ_ENSEMBLE_HPP_
+
+/**
+ * A set of Lorenz oscillators sharing sigma, rho and beta, e.g. one per LED.
+ * The state is kept as planar float arrays so that the whole ensemble is
+ * stepped four oscillators at a time with tiny_simd.
+ */
+class LorenzEnsemble {
+ public:
+  LorenzEnsemble(int numOscillators, float sigma, float rho, float beta);
+  ~LorenzEnsemble();
+
+  int getNumOscillators() const { return m_numOscillators; }
+
+  void setPosition(int i, float x, float y, float z) { m_x[i] = x; m_y[i] = y; m_z[i] = z; }
+
+  void setSigma(float sigma) { m_sigma = sigma; }
+  void setRho(float rho) { m_rho = rho; }
+  void setBeta(float beta) { m_beta = beta; }
+
+  float getSigma() const { return m_sigma; }
+  float getRho() const { return m_rho; }
+  float getBeta() const { return m_beta; }
+
+  /** The longest Euler step taken by process(), in seconds. Defaults to 10ms. */
+  void setMaxStep(float maxStep) { m_maxStep = maxStep; }
+  float getMaxStep() const { return m_maxStep; }
+
+  /**
+   * Advances every oscillator by dt, in equal Euler substeps of at most the
+   * maximum step (see Integrator), and records the range of the new positions
+   * over the whole ensemble.
+   */
+  void process(float dt);
+
+  /**
+   * As process(), for oscillators [begin,end) only. The range of their new positions is
+   * returned in min and max, as {x, y, z}. Disjoint ranges may be processed from
+   * different threads at once.
+   */
+  void process(float dt, int begin, int end, float *min, float *max);
+
+  /** The positions of all oscillators, valid until the next call to process(). */
+  const float *getX() const { return m_x; }
+  const float *getY() const { return m_y; }
+  const float *getZ() const { return m_z; }
+
+  /** The range of positions after the last call to process(). */
+  void getRangeX(float *min, float *max) const { *min = m_min[0]; *max = m_max[0]; }
+  void getRangeY(float *min, float *max) const { *min = m_min[1]; *max = m_max[1]; }
+  void getRangeZ(float *min, float *max) const { *min = m_min[2]; *max = m_max[2]; }
+
+ private:
+  int m_numOscillators;
+  float m_sigma, m_rho, m_beta;
+  float m_maxStep;
+  float *m_x, *m_y, *m_z;
+  float m_min[3], m_max[3];
+};
+
+#endif // _LORENZ_ENSEMBLE_HPP_
@@ -19,28 +19,26 @@
 #include "LorenzOscillator.hpp"
 
 LorenzOscillator::LorenzOscillator(double sigma, double rho, double beta, double x, double y, double z) {
-  m_sigma = sigma; m_rho = rho; m_beta = beta;
-  m_x = x; m_y = y; m_z = z;
-  m_dx = 0.0; m_dy = 0.0; m_dz = 0.0;
-  m_minX = INFINITY; m_minY = INFINITY; m_minZ = INFINITY;
-  m_maxX = -INFINITY; m_maxY = -INFINITY; m_maxZ = -INFINITY;
+  m_system.sigma = sigma; m_system.rho = rho; m_system.beta = beta;
+  m_s[0] = x; m_s[1] = y; m_s[2] = z;
+  for (int i = 0; i < 3; ++i) {
+    m_ds[i] = 0.0;
+    m_min[i] = INFINITY; m_max[i] = -INFINITY;
+  }
 }
 
 LorenzOscillator::~LorenzOscillator() {}
 
 void LorenzOscillator::process(double dt, double *x, double *y, double *z) {
-  m_dx = m_sigma * (m_y - m_x);
-  m_dy = (m_x * (m_rho - m_z)) - m_y;
-  m_dz = m_x*m_y - m_beta*m_z;
+  m_integrator.process(m_system, m_s, dt);
+  m_system(m_s, m_ds);
 
-  m_x += m_dx * dt;
-  m_y += m_dy * dt;
-  m_z += m_dz * dt;
+  for (int i = 0; i < 3; ++i) {
+    m_min[i] = fmin(m_min[i], m_s[i]);
+    m_max[i] = fmax(m_max[i], m_s[i]);
+  }
 
-  m_minX = fmin(m_minX, m_x); m_minY = fmin(m_minY, m_y); m_minZ = fmin(m_minZ, m_z);
-  m_maxX = fmax(m_maxX, m_x); m_maxY = fmax(m_maxY, m_y); m_maxZ = fmax(m_maxZ, m_z);
-
-  *x = m_x;
-  *y = m_y;
-  *z = m_z;
+  *x = m_s[0];
+  *y = m_s[1];
+  *z = m_s[2];
 }
@@ -17,36 +17,54 @@
 #ifndef _LORENZ_OSCILLATOR_HPP_
 #define _LORENZ_OSCILLATOR_HPP_
 
-#include "Animation.hpp"
+#include "Integrator.hpp"
+
+/** The derivative of the Lorenz system, https://en.wikipedia.org/wiki/Lorenz_system */
+struct LorenzSystem {
+  double sigma, rho, beta;
+
+  void operator()(const double *s, double *ds) const {
+    ds[0] = sigma * (s[1] - s[0]);
+    ds[1] = (s[0] * (rho - s[2])) - s[1];
+    ds[2] = s[0]*s[1] - beta*s[2];
+  }
+};
 
 class LorenzOscillator {
  public:
   LorenzOscillator(double sigma, double rho, double beta, double x=0.0, double y=0.0, double z=0.0);
   ~LorenzOscillator();
 
-  void setPosition(double x, double y, double z) { m_x = x; m_y = y; m_z = z; }
+  void setPosition(double x, double y, double z) { m_s[0] = x; m_s[1] = y; m_s[2] = z; }
+
+  void setSigma(double sigma) { m_system.sigma = sigma; }
+  void setRho(double rho) { m_system.rho = rho; }
+  void setBeta(double beta) { m_system.beta = beta; }
 
-  void setSigma(double sigma) { m_sigma = sigma; }
-  void setRho(double rho) { m_rho = rho; }
-  void setBeta(double beta) { m_beta = beta; }
+  double getSigma() const { return m_system.sigma; }
+  double getRho() const { return m_system.rho; }
+  double getBeta() const { return m_system.beta; }
 
-  double getSigma() const { return m_sigma; }
-  double getRho() const { return m_rho; }
-  double getBeta() const { return m_beta; }
+  /** The integrator used by process(). RK4 in steps of at most 10ms by default. */
+  Integrator<3> &getIntegrator() { return m_integrator; }
 
+  /** Advances the oscillator by dt seconds and returns the new position. */
   void process(double dt, double *x, double *y, double *z);
 
-  void getRangeX(double *min, double *max) const { *min = m_minX; *max = m_maxX; }
-  void getRangeY(double *min, double *max) const { *min = m_minY; *max = m_maxY; }
-  void getRangeZ(double *min, double *max) const { *min = m_minZ; *max = m_maxZ; }
+  /** The range of positions over all calls to process(). */
+  void getRangeX(double *min, double *max) const { *min = m_min[0]; *max = m_max[0]; }
+  void getRangeY(double *min, double *max) const { *min = m_min[1]; *max = m_max[1]; }
+  void getRangeZ(double *min, double *max) const { *min = m_min[2]; *max = m_max[2]; }
 
-  void getVelocity(double *dx, double *dy, double *dz) const { *dx = m_dx; *dy = m_dy; *dz = m_dz; }
+  /** The velocity at the current position. */
+  void getVelocity(double *dx, double *dy, double *dz) const { *dx = m_ds[0]; *dy = m_ds[1]; *dz = m_ds[2]; }
 
  private:
-   double m_sigma, m_rho, m_beta;
-   double m_x, m_y, m_z;
-   double m_dx, m_dy, m_dz;
-   double m_minX, m_maxX, m_minY, m_maxY, m_minZ, m_maxZ;
+  LorenzSystem m_system;
+  Integrator<3> m_integrator;
+  double m_s[3]; // x, y, z
+  double m_ds[3];
+  double m_min[3], m_max[3];
 };
 
 #endif // _LORENZ_OSCILLATOR_HPP_
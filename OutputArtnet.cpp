@@ -0,0 +1,186 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <unistd.h>
+
+#include "OutputArtnet.hpp"
+#include "PixelBuffer.hpp"
+
+#define ARTNET_OP_DMX 0x5000
+#define ARTNET_OP_SYNC 0x5200
+#define ARTNET_PROTOCOL_VERSION 14
+
+// the most messages that the kernel accepts in one sendmmsg()
+#define ARTNET_MAX_BATCH 1024
+
+static void __artnet_header(uint8_t *x, uint16_t opcode) {
+  memcpy(x, "Art-Net", 8); // including the terminating zero
+  x[8] = opcode & 0xFF; // little endian
+  x[9] = opcode >> 8;
+  x[10] = 0; // protocol version, big endian
+  x[11] = ARTNET_PROTOCOL_VERSION;
+}
+
+OutputArtnet::OutputArtnet(const char *address) {
+  assert(address != nullptr);
+  strncpy(m_host, address, sizeof(m_host)-1);
+  m_host[sizeof(m_host)-1] = '\0';
+  char *colon = strchr(m_host, ':');
+  if (colon != nullptr) {
+    *colon = '\0';
+    strncpy(m_port, colon+1, sizeof(m_port)-1);
+    m_port[sizeof(m_port)-1] = '\0';
+  } else {
+    snprintf(m_port, sizeof(m_port), "%i", ARTNET_PORT);
+  }
+  m_fd = -1;
+  m_numFrameBytes = -1;
+  m_numLeds = 0;
+  m_numUniverses = 0;
+  m_rgb = nullptr;
+  m_headers = nullptr;
+  m_iov = nullptr;
+  m_msgs = nullptr;
+
+  memset(m_sync, 0, sizeof(m_sync));
+  __artnet_header(m_sync, ARTNET_OP_SYNC); // followed by two zero bytes (Aux1, Aux2)
+}
+
+OutputArtnet::~OutputArtnet() {
+  close();
+  free(m_rgb);
+  free(m_headers);
+  free(m_iov);
+  free(m_msgs);
+}
+
+bool OutputArtnet::open() {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  struct addrinfo *res = nullptr;
+  int ret = getaddrinfo(m_host, m_port, &hints, &res);
+  if (ret != 0) {
+    printf("Could not resolve Art-Net address %s:%s: %s\n", m_host, m_port, gai_strerror(ret));
+    return false;
+  }
+
+  // connect() the socket so that packets need no address of their own
+  m_fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  if (m_fd < 0 || connect(m_fd, res->ai_addr, res->ai_addrlen) != 0) {
+    printf("Could not open Art-Net socket to %s:%s: %s\n", m_host, m_port, strerror(errno));
+    if (m_fd >= 0) ::close(m_fd);
+    m_fd = -1;
+  }
+  freeaddrinfo(res);
+  return (m_fd >= 0);
+}
+
+void OutputArtnet::close() {
+  if (m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+}
+
+void OutputArtnet::__resize(uint32_t numLeds) {
+  m_numLeds = numLeds;
+  m_numUniverses = (numLeds + ARTNET_PIXELS_PER_UNIVERSE - 1) / ARTNET_PIXELS_PER_UNIVERSE;
+
+  m_rgb = (uint8_t *) realloc(m_rgb, 3*numLeds + 1); // never zero bytes
+  m_headers = (uint8_t *) realloc(m_headers, ARTNET_DMX_HEADER_BYTES*m_numUniverses + 1);
+  m_iov = (struct iovec *) realloc(m_iov, 2*m_numUniverses*sizeof(struct iovec) + 1);
+  m_msgs = (struct mmsghdr *) realloc(m_msgs, (m_numUniverses+1)*sizeof(struct mmsghdr));
+  assert(m_rgb != nullptr && m_headers != nullptr && m_iov != nullptr && m_msgs != nullptr);
+  memset(m_msgs, 0, (m_numUniverses+1)*sizeof(struct mmsghdr));
+
+  for (uint32_t u = 0; u < m_numUniverses; ++u) {
+    const uint32_t numPixels = (u < m_numUniverses-1) ? ARTNET_PIXELS_PER_UNIVERSE
+        : numLeds - u*ARTNET_PIXELS_PER_UNIVERSE;
+    const uint32_t numChannels = 3*numPixels + (numPixels & 1); // must be even, the pad is never read
+    uint8_t *x = m_headers + ARTNET_DMX_HEADER_BYTES*u;
+    __artnet_header(x, ARTNET_OP_DMX);
+    x[12] = 0; // sequence, set per frame
+    x[13] = 0; // physical port
+    x[14] = u & 0xFF; // SubUni
+    x[15] = (u >> 8) & 0x7F; // Net
+    x[16] = numChannels >> 8; // length, big endian
+    x[17] = numChannels & 0xFF;
+
+    m_iov[2*u].iov_base = x;
+    m_iov[2*u].iov_len = ARTNET_DMX_HEADER_BYTES;
+    m_iov[2*u+1].iov_base = m_rgb + 3*ARTNET_PIXELS_PER_UNIVERSE*u;
+    m_iov[2*u+1].iov_len = numChannels;
+    m_msgs[u].msg_hdr.msg_iov = m_iov + 2*u;
+    m_msgs[u].msg_hdr.msg_iovlen = 2;
+  }
+  // the odd-length pad of the last universe reads the one spare byte of m_rgb
+  m_rgb[3*numLeds] = 0;
+
+  m_syncIov.iov_base = m_sync;
+  m_syncIov.iov_len = sizeof(m_sync);
+  m_msgs[m_numUniverses].msg_hdr.msg_iov = &m_syncIov;
+  m_msgs[m_numUniverses].msg_hdr.msg_iovlen = 1;
+}
+
+int OutputArtnet::write(int numBytes, const uint8_t *data) {
+  assert(m_fd >= 0);
+  assert(numBytes >= 0);
+  assert(data != nullptr);
+
+  if (numBytes != m_numFrameBytes) {
+    // recover the number of LEDs from the length of the APA-102 frame
+    uint32_t n = (numBytes > 5) ? (numBytes-5)/4 : 0;
+    while (n > 0 && 4 + 4*n + PixelBuffer::getNumSpiTrailerBytes(n) > (uint32_t) numBytes) --n;
+    __resize(n);
+    m_numFrameBytes = numBytes;
+  }
+
+  // GLOBAL, BLUE, GREEN, RED to RED, GREEN, BLUE with the global brightness applied
+  const uint8_t *x = data + 4;
+  for (uint32_t i = 0; i < m_numLeds; ++i, x+=4) {
+    const uint32_t g = x[0] & 0x1F;
+    m_rgb[3*i+0] = (uint8_t) ((x[3]*g) / 31);
+    m_rgb[3*i+1] = (uint8_t) ((x[2]*g) / 31);
+    m_rgb[3*i+2] = (uint8_t) ((x[1]*g) / 31);
+  }
+
+  // every universe counts its own sequence in [1,255] (0 would disable reordering)
+  for (uint32_t u = 0; u < m_numUniverses; ++u) {
+    uint8_t *seq = m_headers + ARTNET_DMX_HEADER_BYTES*u + 12;
+    *seq = (*seq == 255) ? 1 : *seq+1;
+  }
+
+  const uint32_t numMsgs = m_numUniverses + 1;
+  uint32_t numSent = 0;
+  while (numSent < numMsgs) {
+    const uint32_t batch = (numMsgs-numSent < ARTNET_MAX_BATCH) ? numMsgs-numSent : ARTNET_MAX_BATCH;
+    int ret = sendmmsg(m_fd, m_msgs+numSent, batch, 0);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      // e.g. ECONNREFUSED if nobody is listening on localhost, try again next frame
+      printf("Art-Net send fail: %s\n", strerror(errno));
+      return -1;
+    }
+    numSent += ret;
+  }
+
+  _countFrame(numBytes);
+  return numBytes;
+}
@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _OUTPUT_ARTNET_HPP_
+#define _OUTPUT_ARTNET_HPP_
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "OutputDriver.hpp"
+
+#define ARTNET_PORT 6454
+#define ARTNET_PIXELS_PER_UNIVERSE 170 // 510 of the 512 DMX channels
+#define ARTNET_DMX_HEADER_BYTES 18
+
+/**
+ * Sends frames to a remote pixel controller as Art-Net ArtDmx packets over UDP,
+ * 170 RGB pixels per universe starting at universe 0, followed by an ArtSync so that
+ * all universes are shown at once. The spec is artnet:<host>[:<port>].
+ *
+ * APA-102 frames are converted once to 8-bit RGB (with the per-pixel global brightness
+ * applied). Packets are then gathered directly from that buffer and their headers, and
+ * the whole frame is sent with as few sendmmsg() calls as possible.
+ */
+class OutputArtnet: public OutputDriver {
+ public:
+  OutputArtnet(const char *address);
+  ~OutputArtnet();
+
+  bool open() override;
+  void close() override;
+  int write(int numBytes, const uint8_t *data) override;
+
+  const char *getName() override { return "artnet"; }
+
+ private:
+  /** Prepares the packet headers and scatter/gather lists for a strip of the given length. */
+  void __resize(uint32_t numLeds);
+
+  char m_host[128];
+  char m_port[8];
+  int m_fd;
+
+  /** The size of the last frame, and the number of LEDs it contained. */
+  int m_numFrameBytes;
+  uint32_t m_numLeds;
+
+  uint32_t m_numUniverses;
+  uint8_t *m_rgb;     // m_numLeds RGB triplets
+  uint8_t *m_headers; // one ArtDmx header per universe
+  struct iovec *m_iov; // header and data of every universe
+  struct mmsghdr *m_msgs; // one per universe, plus the ArtSync
+  uint8_t m_sync[14]; // the ArtSync packet
+  struct iovec m_syncIov;
+};
+
+#endif // _OUTPUT_ARTNET_HPP_
@@ -0,0 +1,47 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "OutputArtnet.hpp"
+#include "OutputDriver.hpp"
+#include "OutputFile.hpp"
+#include "OutputMulti.hpp"
+#include "OutputNull.hpp"
+#include "OutputShm.hpp"
+#include "OutputSpi.hpp"
+
+OutputDriver *OutputDriver::create(const char *spec) {
+  assert(spec != nullptr);
+
+  // split the spec into name and (optional) argument
+  const char *arg = strchr(spec, ':');
+  const size_t len = (arg != nullptr) ? (size_t) (arg - spec) : strlen(spec);
+  if (arg != nullptr) ++arg;
+
+  if (len == 3 && !strncmp(spec, "spi", len)) {
+    return new OutputSpi((arg != nullptr) ? arg : "/dev/spidev0.0");
+  } else if (len == 4 && !strncmp(spec, "null", len)) {
+    return new OutputNull();
+  } else if (len == 4 && !strncmp(spec, "file", len) && arg != nullptr) {
+    return new OutputFile(arg);
+  } else if (len == 3 && !strncmp(spec, "shm", len)) {
+    return new OutputShm((arg != nullptr) ? arg : "/playatower");
+  } else if (len == 6 && !strncmp(spec, "artnet", len) && arg != nullptr) {
+    return new OutputArtnet(arg);
+  } else if (len == 5 && !strncmp(spec, "multi", len) && arg != nullptr) {
+    return OutputMulti::create(arg);
+  }
+  return nullptr;
+}
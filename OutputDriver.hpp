@@ -0,0 +1,83 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _OUTPUT_DRIVER_HPP_
+#define _OUTPUT_DRIVER_HPP_
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * A sink for fully encoded APA-102 frames, as produced by PixelBuffer::prepareAndGetSpiBytes().
+ *
+ * Drivers are selected with a spec string of the form <name>[:<argument>], e.g.
+ *
+ *   spi:/dev/spidev0.0   the LED strip on a spidev device (default)
+ *   null                 discards all frames, only counts bytes
+ *   file:/tmp/leds.raw   appends raw frames to a file or named pipe
+ *   shm:/playatower      publishes the latest frame in POSIX shared memory
+ *   artnet:host[:port]   sends Art-Net DMX universes over UDP to a pixel controller
+ *   multi:<spec>=<n>,... splits the strip into segments of n LEDs, one driver each
+ */
+class OutputDriver {
+ public:
+  OutputDriver() : _numBytesWritten(0), _numFramesWritten(0) {}
+  virtual ~OutputDriver() {}
+
+  /**
+   * Creates a driver from a spec string. The driver is not yet opened.
+   *
+   * @return  The new driver, or nullptr if the spec is not recognised.
+   */
+  static OutputDriver *create(const char *spec);
+
+  /** Opens the underlying device. Returns true on success. */
+  virtual bool open() = 0;
+
+  /** Closes the underlying device. */
+  virtual void close() {}
+
+  /**
+   * Writes one frame. A drop-in replacement for tspi_write().
+   *
+   * @return  Returns the number of bytes written, or -1 on error.
+   */
+  virtual int write(int numBytes, const uint8_t *data) = 0;
+
+  /** Get the name of this driver. */
+  virtual const char *getName() { return "output"; }
+
+  /** Returns the total number of bytes written to date. */
+  uint64_t getNumBytesWritten() const { return _numBytesWritten; }
+
+  /** Returns the total number of frames written to date. */
+  uint32_t getNumFramesWritten() const { return _numFramesWritten; }
+
+ protected:
+  /** Updates the byte and frame counters after a successful write. */
+  void _countFrame(int numBytes) {
+    _numBytesWritten += numBytes;
+    ++_numFramesWritten;
+  }
+
+  uint64_t _numBytesWritten;
+  uint32_t _numFramesWritten;
+};
+
+#endif // _OUTPUT_DRIVER_HPP_
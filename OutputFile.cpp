@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "OutputFile.hpp"
+
+OutputFile::OutputFile(const char *path) {
+  assert(path != nullptr);
+  strncpy(m_path, path, sizeof(m_path)-1);
+  m_path[sizeof(m_path)-1] = '\0';
+  m_fd = -1;
+}
+
+OutputFile::~OutputFile() {
+  close();
+}
+
+bool OutputFile::open() {
+  // NOTE: opening a named pipe blocks until there is a reader on the other end
+  m_fd = ::open(m_path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if (m_fd < 0) printf("Could not open output file %s: %s\n", m_path, strerror(errno));
+  return (m_fd >= 0);
+}
+
+void OutputFile::close() {
+  if (m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+}
+
+int OutputFile::write(int numBytes, const uint8_t *data) {
+  assert(m_fd >= 0);
+  assert(numBytes >= 0);
+  assert(data != nullptr);
+
+  // pipes may accept only part of a frame at a time
+  int n = 0;
+  while (n < numBytes) {
+    ssize_t ret = ::write(m_fd, data+n, numBytes-n);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      printf("Output file write fail: %s\n", strerror(errno));
+      return -1;
+    }
+    n += (int) ret;
+  }
+
+  _countFrame(numBytes);
+  return numBytes;
+}
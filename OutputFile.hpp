@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _OUTPUT_FILE_HPP_
+#define _OUTPUT_FILE_HPP_
+
+#include "OutputDriver.hpp"
+
+/**
+ * Appends raw APA-102 frames to a file, device or named pipe. Frames are written
+ * back-to-back, exactly as they would appear on the SPI bus.
+ */
+class OutputFile: public OutputDriver {
+ public:
+  OutputFile(const char *path);
+  ~OutputFile();
+
+  bool open() override;
+  void close() override;
+  int write(int numBytes, const uint8_t *data) override;
+
+  const char *getName() override { return "file"; }
+
+ private:
+  char m_path[256];
+  int m_fd;
+};
+
+#endif // _OUTPUT_FILE_HPP_
@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "OutputMulti.hpp"
+#include "PixelBuffer.hpp"
+
+OutputMulti::OutputMulti() {
+  memset(m_segments, 0, sizeof(m_segments));
+  m_numSegments = 0;
+  m_numLeds = 0;
+  m_isOpen = false;
+  m_isRunning = false;
+  pthread_mutex_init(&m_startLock, NULL);
+}
+
+OutputMulti *OutputMulti::create(const char *arg) {
+  assert(arg != nullptr);
+
+  OutputMulti *o = new OutputMulti();
+  char *specs = strdup(arg);
+  char *saveptr = nullptr;
+  for (char *s = strtok_r(specs, ",", &saveptr); s != nullptr; s = strtok_r(nullptr, ",", &saveptr)) {
+    // each segment is <driver spec>=<number of LEDs>
+    char *eq = strrchr(s, '=');
+    const int numLeds = (eq != nullptr) ? atoi(eq+1) : 0;
+    if (numLeds <= 0 || o->m_numSegments == OUTPUT_MULTI_MAX_SEGMENTS) {
+      printf("Invalid multi output segment: %s\n", s);
+      free(specs); delete o;
+      return nullptr;
+    }
+    *eq = '\0';
+    OutputDriver *driver = OutputDriver::create(s);
+    if (driver == nullptr) {
+      printf("Unknown output driver: %s\n", s);
+      free(specs); delete o;
+      return nullptr;
+    }
+
+    Segment *seg = o->m_segments + o->m_numSegments++;
+    seg->multi = o;
+    seg->driver = driver;
+    seg->firstLed = o->m_numLeds;
+    seg->numLeds = (uint32_t) numLeds;
+    seg->numFrameBytes = 4 + 4*seg->numLeds + PixelBuffer::getNumSpiTrailerBytes(seg->numLeds);
+    seg->frame = (uint8_t *) malloc(seg->numFrameBytes);
+    assert(seg->frame != nullptr);
+    memset(seg->frame, 0, 4); // start frame
+    memset(seg->frame + 4 + 4*seg->numLeds, 0xFF, seg->numFrameBytes - 4 - 4*seg->numLeds); // trailer
+    o->m_numLeds += seg->numLeds;
+  }
+  free(specs);
+
+  if (o->m_numSegments == 0) {
+    delete o;
+    return nullptr;
+  }
+  return o;
+}
+
+OutputMulti::~OutputMulti() {
+  close();
+  for (int i = 0; i < m_numSegments; ++i) {
+    delete m_segments[i].driver;
+    free(m_segments[i].frame);
+  }
+  pthread_mutex_destroy(&m_startLock);
+}
+
+bool OutputMulti::open() {
+  assert(!m_isOpen);
+  for (int i = 0; i < m_numSegments; ++i) {
+    if (!m_segments[i].driver->open()) {
+      while (--i >= 0) m_segments[i].driver->close();
+      return false;
+    }
+  }
+
+  // every segment thread plus the caller of write()
+  pthread_barrier_init(&m_start, NULL, m_numSegments+1);
+  pthread_barrier_init(&m_done, NULL, m_numSegments+1);
+
+  // no thread may reach the barriers unless all of them have started, as they would
+  // wait there forever
+  pthread_mutex_lock(&m_startLock);
+  m_isRunning = true;
+  int numStarted = 0;
+  while (numStarted < m_numSegments &&
+      pthread_create(&m_segments[numStarted].thread, NULL, &__run, m_segments+numStarted) == 0) {
+    ++numStarted;
+  }
+  if (numStarted < m_numSegments) {
+    printf("Could not start output segment thread %i.\n", numStarted);
+    m_isRunning = false;
+  }
+  pthread_mutex_unlock(&m_startLock);
+
+  if (!m_isRunning) {
+    for (int i = 0; i < numStarted; ++i) pthread_join(m_segments[i].thread, NULL);
+    pthread_barrier_destroy(&m_start);
+    pthread_barrier_destroy(&m_done);
+    for (int i = 0; i < m_numSegments; ++i) m_segments[i].driver->close();
+    return false;
+  }
+  m_isOpen = true;
+  return true;
+}
+
+void OutputMulti::close() {
+  if (!m_isOpen) return;
+  m_isRunning = false;
+  pthread_barrier_wait(&m_start); // release the threads, which will see that they should exit
+  for (int i = 0; i < m_numSegments; ++i) {
+    pthread_join(m_segments[i].thread, NULL);
+    m_segments[i].driver->close();
+  }
+  pthread_barrier_destroy(&m_start);
+  pthread_barrier_destroy(&m_done);
+  m_isOpen = false;
+}
+
+int OutputMulti::write(int numBytes, const uint8_t *data) {
+  assert(m_isOpen);
+  assert(data != nullptr);
+  if ((uint32_t) numBytes < 4 + 4*m_numLeds) {
+    printf("Frame of %i bytes is too short for %i LEDs.\n", numBytes, m_numLeds);
+    return -1;
+  }
+
+  // copy the LED data of each segment between its start frame and trailer
+  for (int i = 0; i < m_numSegments; ++i) {
+    Segment *seg = m_segments + i;
+    memcpy(seg->frame + 4, data + 4 + 4*seg->firstLed, 4*seg->numLeds);
+  }
+
+  pthread_barrier_wait(&m_start);
+  pthread_barrier_wait(&m_done); // all segments have been written
+
+  int total = 0;
+  for (int i = 0; i < m_numSegments; ++i) {
+    if (m_segments[i].result < 0) return -1;
+    total += m_segments[i].result;
+  }
+  _countFrame(total);
+  return total;
+}
+
+void *OutputMulti::__run(void *q) {
+  Segment *seg = (Segment *) q;
+  OutputMulti *o = seg->multi;
+
+  // wait until open() has started every thread, or given up
+  pthread_mutex_lock(&o->m_startLock);
+  const bool isStarted = o->m_isRunning;
+  pthread_mutex_unlock(&o->m_startLock);
+  if (!isStarted) return NULL;
+
+  while (true) {
+    pthread_barrier_wait(&o->m_start);
+    if (!o->m_isRunning) break;
+    seg->result = seg->driver->write(seg->numFrameBytes, seg->frame);
+    pthread_barrier_wait(&o->m_done);
+  }
+  return NULL;
+}
@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _OUTPUT_MULTI_HPP_
+#define _OUTPUT_MULTI_HPP_
+
+#include <pthread.h>
+
+#include "OutputDriver.hpp"
+
+#define OUTPUT_MULTI_MAX_SEGMENTS 8
+
+/**
+ * Splits each frame into consecutive segments of LEDs and writes every segment to its
+ * own driver (e.g. a separate spidev node), all at the same time from one thread per
+ * segment. Each segment is sent as a complete APA-102 frame with its own start bytes
+ * and trailer, so the refresh rate scales with the number of buses rather than the
+ * length of the strip.
+ *
+ * The spec lists the drivers and segment lengths in order, separated by commas, e.g.
+ *
+ *   multi:spi:/dev/spidev0.0=300,spi:/dev/spidev0.1=300
+ *
+ * LEDs beyond the last segment are not written.
+ */
+class OutputMulti: public OutputDriver {
+ public:
+  /**
+   * Creates a driver from the argument of a multi spec (everything after "multi:").
+   *
+   * @return  The new driver, or nullptr if the argument is malformed.
+   */
+  static OutputMulti *create(const char *arg);
+
+  ~OutputMulti();
+
+  bool open() override;
+  void close() override;
+  int write(int numBytes, const uint8_t *data) override;
+
+  const char *getName() override { return "multi"; }
+
+ private:
+  typedef struct {
+    OutputMulti *multi;
+    OutputDriver *driver;
+    uint32_t firstLed;
+    uint32_t numLeds;
+    uint8_t *frame; // the complete APA-102 frame for this segment
+    uint32_t numFrameBytes;
+    int result; // the return value of the last write
+    pthread_t thread;
+  } Segment;
+
+  OutputMulti();
+
+  static void *__run(void *q);
+
+  Segment m_segments[OUTPUT_MULTI_MAX_SEGMENTS];
+  int m_numSegments;
+
+  /** The total number of LEDs across all segments. */
+  uint32_t m_numLeds;
+
+  /** Synchronises the segment threads at the start and end of every frame. */
+  pthread_barrier_t m_start;
+  pthread_barrier_t m_done;
+
+  /** Held by open() while it starts the segment threads, which wait for it before the barriers. */
+  pthread_mutex_t m_startLock;
+
+  bool m_isOpen;
+  volatile bool m_isRunning;
+};
+
+#endif // _OUTPUT_MULTI_HPP_
@@ -0,0 +1,40 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _OUTPUT_NULL_HPP_
+#define _OUTPUT_NULL_HPP_
+
+#include "OutputDriver.hpp"
+
+/** Discards all frames. Useful for measuring render throughput without the SPI bus. */
+class OutputNull: public OutputDriver {
+ public:
+  OutputNull() {}
+  ~OutputNull() {}
+
+  bool open() override { return true; }
+
+  int write(int numBytes, const uint8_t *data) override {
+    assert(numBytes >= 0);
+    assert(data != nullptr);
+    _countFrame(numBytes);
+    return numBytes;
+  }
+
+  const char *getName() override { return "null"; }
+};
+
+#endif // _OUTPUT_NULL_HPP_
@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "OutputShm.hpp"
+
+OutputShm::OutputShm(const char *name) {
+  assert(name != nullptr);
+  strncpy(m_name, name, sizeof(m_name)-1);
+  m_name[sizeof(m_name)-1] = '\0';
+  m_fd = -1;
+  m_header = nullptr;
+  m_mapLength = 0;
+}
+
+OutputShm::~OutputShm() {
+  close();
+}
+
+bool OutputShm::open() {
+  m_fd = shm_open(m_name, O_CREAT|O_RDWR, 0644);
+  if (m_fd < 0) {
+    printf("Could not open shared memory %s: %s\n", m_name, strerror(errno));
+    return false;
+  }
+  // the segment is sized on the first write, once the frame size is known
+  return __map(0);
+}
+
+void OutputShm::close() {
+  if (m_header != nullptr) {
+    munmap(m_header, m_mapLength);
+    m_header = nullptr;
+    m_mapLength = 0;
+  }
+  if (m_fd >= 0) {
+    ::close(m_fd);
+    shm_unlink(m_name);
+    m_fd = -1;
+  }
+}
+
+bool OutputShm::__map(uint32_t numBytes) {
+  const size_t length = sizeof(OutputShmHeader) + numBytes;
+  if (m_header != nullptr) munmap(m_header, m_mapLength);
+
+  if (ftruncate(m_fd, length) != 0) {
+    printf("Could not resize shared memory %s: %s\n", m_name, strerror(errno));
+    m_header = nullptr;
+    return false;
+  }
+
+  void *map = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (map == MAP_FAILED) {
+    printf("Could not map shared memory %s: %s\n", m_name, strerror(errno));
+    m_header = nullptr;
+    return false;
+  }
+
+  m_header = (OutputShmHeader *) map;
+  m_mapLength = length;
+  m_header->magic = OUTPUT_SHM_MAGIC;
+  m_header->capacity = numBytes;
+  return true;
+}
+
+int OutputShm::write(int numBytes, const uint8_t *data) {
+  assert(m_fd >= 0);
+  assert(numBytes >= 0);
+  assert(data != nullptr);
+
+  if (m_header == nullptr || (uint32_t) numBytes > m_header->capacity) {
+    if (!__map(numBytes)) return -1;
+  }
+
+  __atomic_add_fetch(&m_header->sequence, 1, __ATOMIC_ACQ_REL); // odd, frame is being written
+  m_header->numBytes = numBytes;
+  memcpy(m_header+1, data, numBytes);
+  __atomic_add_fetch(&m_header->sequence, 1, __ATOMIC_RELEASE); // even, frame is complete
+
+  _countFrame(numBytes);
+  return numBytes;
+}
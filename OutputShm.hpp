@@ -0,0 +1,60 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _OUTPUT_SHM_HPP_
+#define _OUTPUT_SHM_HPP_
+
+#include "OutputDriver.hpp"
+
+#define OUTPUT_SHM_MAGIC 0x57544150 // "PATW"
+
+/**
+ * The layout of the shared memory segment. The frame data follows the header directly.
+ *
+ * Readers should use the sequence number as a seqlock: it is odd while a frame is being
+ * written. Read the sequence, copy the frame, and retry if the sequence was odd or has
+ * changed in the meantime.
+ */
+typedef struct {
+  uint32_t magic;     // OUTPUT_SHM_MAGIC
+  uint32_t sequence;  // incremented before and after every frame
+  uint32_t numBytes;  // the number of valid bytes in the current frame
+  uint32_t capacity;  // the number of bytes available after the header
+} OutputShmHeader;
+
+/** Publishes the latest frame in a POSIX shared memory segment. */
+class OutputShm: public OutputDriver {
+ public:
+  OutputShm(const char *name);
+  ~OutputShm();
+
+  bool open() override;
+  void close() override;
+  int write(int numBytes, const uint8_t *data) override;
+
+  const char *getName() override { return "shm"; }
+
+ private:
+  /** Resizes and maps the segment such that it can hold at least numBytes of frame data. */
+  bool __map(uint32_t numBytes);
+
+  char m_name[64];
+  int m_fd;
+  OutputShmHeader *m_header;
+  size_t m_mapLength;
+};
+
+#endif // _OUTPUT_SHM_HPP_
@@ -0,0 +1,49 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "OutputSpi.hpp"
+
+OutputSpi::OutputSpi(const char *path, uint32_t speed) {
+  assert(path != nullptr);
+  strncpy(m_path, path, sizeof(m_path)-1);
+  m_path[sizeof(m_path)-1] = '\0';
+  m_speed = speed;
+  m_isOpen = false;
+}
+
+OutputSpi::~OutputSpi() {
+  close();
+}
+
+bool OutputSpi::open() {
+  m_isOpen = (tspi_open(&m_tspi, m_path, m_speed) >= 0);
+  if (!m_isOpen) printf("Could not open SPI device %s.\n", m_path);
+  return m_isOpen;
+}
+
+void OutputSpi::close() {
+  if (m_isOpen) {
+    tspi_close(&m_tspi);
+    m_isOpen = false;
+  }
+}
+
+int OutputSpi::write(int numBytes, const uint8_t *data) {
+  assert(m_isOpen);
+  int ret = tspi_write(&m_tspi, numBytes, (uint8_t *) data);
+  if (ret >= 0) _countFrame(numBytes);
+  return ret;
+}
@@ -14,32 +14,31 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
-#ifndef _ANIM_REACTION_DIFFUSION_HPP_
-#define _ANIM_REACTION_DIFFUSION_HPP_
+#ifndef _OUTPUT_SPI_HPP_
+#define _OUTPUT_SPI_HPP_
 
-#include "Animation.hpp"
+#include "OutputDriver.hpp"
+#include "tiny_spi.h"
 
-class AnimReactionDiffusion: public Animation {
+#define SPI_HZ 9000000
+
+/** Writes frames to an LED strip attached to a spidev device. */
+class OutputSpi: public OutputDriver {
  public:
-  AnimReactionDiffusion(PixelBuffer *pixbuf);
-  ~AnimReactionDiffusion();
+  OutputSpi(const char *path, uint32_t speed=SPI_HZ);
+  ~OutputSpi();
+
+  bool open() override;
+  void close() override;
+  int write(int numBytes, const uint8_t *data) override;
 
-  const char *getName() override { return "Reaction Diffusion"; }
+  const char *getName() override { return "spi"; }
 
  private:
-  void _process(double dt) override;
-  // void __sample_grid(float );
-  float __get_grid_value(float *grid, int grid_index, int x, int y);
-  void __set_grid_value(float *grid, int grid_index, int x, int y, float f);
-
-  int m_height;
-  int m_width;
-  float *m_u_grid;
-  float *m_v_grid;
-  int m_grid_index;
-  std::uniform_real_distribution<float> m_d_uniform;
-
-  float m_scan_freq; // Hz
+  char m_path[64];
+  uint32_t m_speed; // hz
+  TinySpi m_tspi;
+  bool m_isOpen;
 };
 
-#endif // _ANIM_REACTION_DIFFUSION_HPP_
+#endif // _OUTPUT_SPI_HPP_
@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <time.h>
+
+#include "OutputThread.hpp"
+
+OutputThread::OutputThread(OutputDriver *output, uint32_t maxBytes) {
+  assert(output != nullptr);
+  _output = output;
+  for (int i = 0; i < 3; ++i) {
+    _buffers[i] = (uint8_t *) malloc(maxBytes);
+    assert(_buffers[i] != nullptr);
+    _numBytes[i] = 0;
+  }
+  _back = 0;
+  _pending = 1;
+  _front = 2;
+  _hasPending = false;
+  _isRunning = false;
+  _thread = 0;
+  pthread_mutex_init(&_mutex, NULL);
+  pthread_cond_init(&_cond, NULL);
+  _numFramesDropped.store(0);
+  _numWriteErrors.store(0);
+  _lastWriteNs.store(0);
+}
+
+OutputThread::~OutputThread() {
+  stop();
+  pthread_cond_destroy(&_cond);
+  pthread_mutex_destroy(&_mutex);
+  for (int i = 0; i < 3; ++i) free(_buffers[i]);
+}
+
+bool OutputThread::start() {
+  assert(!_isRunning);
+  _isRunning = true;
+  if (pthread_create(&_thread, NULL, &_run, this) != 0) {
+    printf("Could not start the output thread.\n");
+    _isRunning = false;
+    return false;
+  }
+  return true;
+}
+
+void OutputThread::stop() {
+  pthread_mutex_lock(&_mutex);
+  const bool wasRunning = _isRunning;
+  _isRunning = false;
+  pthread_cond_broadcast(&_cond);
+  pthread_mutex_unlock(&_mutex);
+  if (wasRunning) pthread_join(_thread, NULL);
+}
+
+void OutputThread::submit(int numBytes, const uint8_t *data, bool block) {
+  assert(numBytes >= 0);
+  assert(data != nullptr);
+
+  // the back buffer belongs to the caller, fill it without holding the lock
+  memcpy(_buffers[_back], data, numBytes);
+  _numBytes[_back] = numBytes;
+
+  pthread_mutex_lock(&_mutex);
+  if (block) {
+    while (_hasPending && _isRunning) pthread_cond_wait(&_cond, &_mutex);
+  }
+  if (_hasPending) _numFramesDropped.fetch_add(1, std::memory_order_relaxed); // the pending frame was never written
+  const int t = _back; _back = _pending; _pending = t;
+  _hasPending = true;
+  pthread_cond_broadcast(&_cond);
+  pthread_mutex_unlock(&_mutex);
+}
+
+void *OutputThread::_run(void *q) {
+  OutputThread *o = (OutputThread *) q;
+  struct timespec tick, tock;
+
+  pthread_mutex_lock(&o->_mutex);
+  while (true) {
+    while (!o->_hasPending && o->_isRunning) pthread_cond_wait(&o->_cond, &o->_mutex);
+    if (!o->_hasPending) break; // stopped, and nothing left to write
+
+    const int t = o->_front; o->_front = o->_pending; o->_pending = t;
+    o->_hasPending = false;
+    pthread_cond_broadcast(&o->_cond); // wake a blocking submit()
+    pthread_mutex_unlock(&o->_mutex);
+
+    clock_gettime(CLOCK_MONOTONIC, &tick);
+    const int numWritten = o->_output->write(o->_numBytes[o->_front], o->_buffers[o->_front]);
+    clock_gettime(CLOCK_MONOTONIC, &tock);
+    if (numWritten < 0) o->_numWriteErrors.fetch_add(1, std::memory_order_relaxed);
+    o->_lastWriteNs.store((uint64_t) ((tock.tv_sec - tick.tv_sec) * 1000000000LL + (tock.tv_nsec - tick.tv_nsec)),
+        std::memory_order_relaxed);
+
+    pthread_mutex_lock(&o->_mutex);
+  }
+  pthread_mutex_unlock(&o->_mutex);
+
+  return NULL;
+}
@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _OUTPUT_THREAD_HPP_
+#define _OUTPUT_THREAD_HPP_
+
+#include <pthread.h>
+#include <atomic>
+
+#include "OutputDriver.hpp"
+
+/**
+ * Writes frames to an OutputDriver from a dedicated thread, so that the next frame
+ * can be rendered while the current one is still on the wire.
+ *
+ * Frames are handed over through a triple buffer: the caller fills the back buffer,
+ * the thread writes the front buffer, and the pending buffer sits in between. If the
+ * caller submits faster than the driver can write, the pending frame is replaced by
+ * the newer one (and counted as dropped), unless submit() is asked to block.
+ */
+class OutputThread {
+ public:
+  /**
+   * @param output  The driver to write to. It must already be open. Not owned.
+   * @param maxBytes  The largest frame that will ever be submitted.
+   */
+  OutputThread(OutputDriver *output, uint32_t maxBytes);
+  ~OutputThread();
+
+  /** Starts the writer thread. Returns true on success. */
+  bool start();
+
+  /** Writes any pending frame, then stops the writer thread. */
+  void stop();
+
+  /**
+   * Copies a frame and queues it for writing.
+   *
+   * @param block  If true, wait until the previous frame has been picked up by the
+   *               writer thread instead of replacing it.
+   */
+  void submit(int numBytes, const uint8_t *data, bool block=false);
+
+  /** Returns the number of frames that were replaced before they could be written. */
+  uint32_t getNumFramesDropped() const { return _numFramesDropped.load(std::memory_order_relaxed); }
+
+  /** Returns the number of frames that OutputDriver::write() failed to write. */
+  uint32_t getNumWriteErrors() const { return _numWriteErrors.load(std::memory_order_relaxed); }
+
+  /** Returns the time taken by the most recent OutputDriver::write(), in nanoseconds. */
+  uint64_t getLastWriteNs() const { return _lastWriteNs.load(std::memory_order_relaxed); }
+
+ private:
+  static void *_run(void *q);
+
+  OutputDriver *_output;
+
+  uint8_t *_buffers[3];
+  int _numBytes[3];
+  int _back;    // owned by the caller
+  int _pending; // shared, guarded by _mutex
+  int _front;   // owned by the writer thread
+  bool _hasPending;
+
+  bool _isRunning;
+  pthread_t _thread;
+  pthread_mutex_t _mutex;
+  pthread_cond_t _cond;
+
+  // read without holding _mutex
+  std::atomic<uint32_t> _numFramesDropped;
+  std::atomic<uint32_t> _numWriteErrors;
+  std::atomic<uint64_t> _lastWriteNs;
+};
+
+#endif // _OUTPUT_THREAD_HPP_
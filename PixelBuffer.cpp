@@ -14,73 +14,127 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
-#include <arm_neon.h>
 #include <math.h>
+#include <pthread.h>
+
+#include <algorithm>
+#include <utility>
 
 #include "PixelBuffer.hpp"
+#include "tiny_simd.h"
 
-// out = in**2.8
-static const uint8_t APA102_GAMMA[] = {
-    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
-    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  1,  1,  1,
-    1,  1,  1,  1,  1,  1,  1,  1,  1,  2,  2,  2,  2,  2,  2,  2,
-    2,  3,  3,  3,  3,  3,  3,  3,  4,  4,  4,  4,  4,  5,  5,  5,
-    5,  6,  6,  6,  6,  7,  7,  7,  7,  8,  8,  8,  9,  9,  9, 10,
-   10, 10, 11, 11, 11, 12, 12, 13, 13, 13, 14, 14, 15, 15, 16, 16,
-   17, 17, 18, 18, 19, 19, 20, 20, 21, 21, 22, 22, 23, 24, 24, 25,
-   25, 26, 27, 27, 28, 29, 29, 30, 31, 32, 32, 33, 34, 35, 35, 36,
-   37, 38, 39, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 50,
-   51, 52, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63, 64, 66, 67, 68,
-   69, 70, 72, 73, 74, 75, 77, 78, 79, 81, 82, 83, 85, 86, 87, 89,
-   90, 92, 93, 95, 96, 98, 99,101,102,104,105,107,109,110,112,114,
-  115,117,119,120,122,124,126,127,129,131,133,135,137,138,140,142,
-  144,146,148,150,152,154,156,158,160,162,164,167,169,171,173,175,
-  177,180,182,184,186,189,191,193,196,198,200,203,205,208,210,213,
-  215,218,220,223,225,228,231,233,236,239,241,244,247,249,252,255 };
-
-PixelBuffer::PixelBuffer(uint32_t numLeds) {
+PixelBuffer::PixelBuffer(uint32_t numLeds, Format format) {
   m_numLeds = numLeds;
+  m_format = format;
   m_global = 1.0f;
   m_ampLimit = INFINITY;
+  m_nightshift = 0.0f;
+  setNightshift(0.0f);
+  m_currentAmps = 0.0f;
+  m_isPowerSuppressionEngaged = false;
+  m_powerScale = 1.0f;
+  m_powerAttack = 1.0f;
+  m_powerRelease = 0.05f;
+  setChannelCurrent(0.02f, 0.02f, 0.02f);
+  m_useMhrothLut = false;
+  m_hdr = false;
+  m_dither = false;
+  __build_mhroth_lut();
+  setGamma(DEFAULT_GAMMA);
 
   // RGB buffer. Order is global, blue, green, red (same as APA-102 datastream). 4xfloat = 16 bytes per pixel
   // NOTE(mhroth): prepareAndGetSpiBytes() functions on the basis of 4 ARGB pixels at a time.
   // m_rgb must therefore be a multiple of 4*16 bytes (4 pixels) == 64 bytes
-  m_numRgbBytesTotal = ((4 * m_numLeds * sizeof(float)) + 63) & ~0x3F;
-  m_rgb = (float *) malloc(m_numRgbBytesTotal);
-  assert(m_rgb != nullptr);
+  // In FIXED16 format the same layout is stored as 4xuint16_t = 8 bytes per pixel, so a multiple of 32 bytes.
+  // In PLANAR format each plane is padded to a multiple of 16 floats == 64 bytes.
+  m_rgb = nullptr;
+  m_rgb16 = nullptr;
+  m_planeStride = 0;
+  if (m_format == PLANAR) {
+    m_planeStride = (m_numLeds + 15) & ~0xF;
+    m_numRgbBytesTotal = 3 * m_planeStride * sizeof(float);
+    m_rgb = (float *) malloc(m_numRgbBytesTotal);
+    assert(m_rgb != nullptr);
+  } else if (m_format == FIXED16) {
+    m_numRgbBytesTotal = ((4 * m_numLeds * sizeof(uint16_t)) + 31) & ~0x1F;
+    m_rgb16 = (uint16_t *) malloc(m_numRgbBytesTotal);
+    assert(m_rgb16 != nullptr);
+  } else {
+    m_numRgbBytesTotal = ((4 * m_numLeds * sizeof(float)) + 63) & ~0x3F;
+    m_rgb = (float *) malloc(m_numRgbBytesTotal);
+    assert(m_rgb != nullptr);
+  }
 
   // prepare SPI data
   // https://cpldcpu.com/2014/11/30/understanding-the-apa102-superled/
   // NOTE(mhroth): because getSpiBytes() processes 4 LEDS at a time (i.e. 16-byte output),
   // and so that no memory outside of spi_data will be overwritten,
   // ((4*m_numLeds) + numSpiTrailerBytes) must be positive mulitple of 16.
-  m_numSpiTrailerBytes = (m_numLeds >> 4) + 1;
+  m_numSpiTrailerBytes = getNumSpiTrailerBytes(m_numLeds);
   m_numSpiBytes = 4 + (4*m_numLeds) + m_numSpiTrailerBytes;
-  // ensure that it is the next largest multiple-of-16 (if necessary)
-  m_numSpiBytesTotal = (m_numSpiBytes + 15) & ~0xF;
+  // ensure that it is the next largest multiple-of-16 (if necessary), and that it covers
+  // the whole last block of 4 LEDs, which is written even if the strip ends inside it
+  m_numSpiBytesTotal = (std::max(m_numSpiBytes, (uint32_t) (4 + 16*((m_numLeds+3)/4))) + 15) & ~0xF;
   m_spiData = (uint8_t *) malloc(m_numSpiBytesTotal);
   assert(m_spiData != nullptr);
 
+  // dithering error, one float per byte of LED data, in blocks of 4 LEDs
+  m_ditherError = (float *) malloc(16 * ((m_numLeds+3)/4) * sizeof(float));
+  assert(m_ditherError != nullptr);
+
+  // one dirty flag per block of 4 LEDs
+  m_dirtyBlocks = (uint8_t *) calloc((m_numLeds+3)/4, 1);
+  assert(m_dirtyBlocks != nullptr);
+  m_blockAmps = (float *) malloc(((m_numLeds+3)/4) * sizeof(float));
+  assert(m_blockAmps != nullptr);
+  m_hasBlockAmps = false;
+  m_isDirty.store(false, std::memory_order_relaxed);
+  m_encodedPowerScale = m_powerScale;
+
   // reset all buffers
   clear();
 }
 
 PixelBuffer::~PixelBuffer() {
   free(m_rgb);
+  free(m_rgb16);
   free(m_spiData);
+  free(m_ditherError);
+  free(m_dirtyBlocks);
+  free(m_blockAmps);
+}
+
+bool PixelBuffer::parseFormat(const char *name, Format *format) {
+  if (!strcmp(name, "float")) *format = FLOAT;
+  else if (!strcmp(name, "fixed16")) *format = FIXED16;
+  else if (!strcmp(name, "planar")) *format = PLANAR;
+  else return false;
+  return true;
 }
 
 void PixelBuffer::clear() {
   // reset RGB buffer
-  memset(m_rgb, 0, m_numRgbBytesTotal);
+  if (m_format == FIXED16) memset(m_rgb16, 0, m_numRgbBytesTotal);
+  else memset(m_rgb, 0, m_numRgbBytesTotal);
 
   // reset SPI buffer
   memset(m_spiData, 0, m_numSpiBytesTotal); // leading zeros
+  invalidate();
+}
+
+void PixelBuffer::setDither(bool enabled) {
+  if (enabled && !m_dither) {
+    // start halfway, so that the first frame is rounded as without dithering
+    for (int i = 0; i < 16 * ((m_numLeds+3)/4); ++i) m_ditherError[i] = 0.5f;
+  }
+  m_dither = enabled;
+  invalidate();
 }
 
 void PixelBuffer::setGlobal(float g) {
-  m_global = fminf(1.0f, fmaxf(0.0f, g));
+  g = fminf(1.0f, fmaxf(0.0f, g));
+  if (g != m_global) invalidate();
+  m_global = g;
 }
 
 void PixelBuffer::setPowerLimit(float wattLimit) {
@@ -91,6 +145,18 @@ float PixelBuffer::getPowerLimit() {
   return !isinf(m_ampLimit) ? 5.0f*m_ampLimit : -1.0f;
 }
 
+void PixelBuffer::setPowerLimitResponse(float attack, float release) {
+  m_powerAttack = fminf(1.0f, fmaxf(0.0f, attack));
+  m_powerRelease = fminf(1.0f, fmaxf(0.0f, release));
+}
+
+void PixelBuffer::setChannelCurrent(float red, float green, float blue) {
+  m_channelAmps[0] = fmaxf(0.0f, red);
+  m_channelAmps[1] = fmaxf(0.0f, green);
+  m_channelAmps[2] = fmaxf(0.0f, blue);
+  invalidate();
+}
+
 // https://gist.github.com/paulkaplan/5184275
 // http://www.tannerhelland.com/4435/convert-temperature-rgb-algorithm-code/
 static void __kelvin_to_rgb(float kelvin, float *r, float *g, float *b) {
@@ -111,108 +177,661 @@ static void __kelvin_to_rgb(float kelvin, float *r, float *g, float *b) {
   *b = fmaxf(0.0f, fminf(1.0f, _b));
 }
 
+void PixelBuffer::setNightshift(float nightshift) {
+  if (nightshift != m_nightshift) invalidate();
+  m_nightshift = nightshift;
+  // the white point, so that it isn't computed every frame
+  __kelvin_to_rgb(6600.0f*(1.0f-m_nightshift), m_nightshiftRgb, m_nightshiftRgb+1, m_nightshiftRgb+2);
+}
+
+/*
+ * FIXED16 helpers. Colour channels are Q1.15, i.e. 0x8000 is 1.0 and values saturate just below 2.0.
+ * Alpha, gain and nightshift are Q0.16, i.e. 0xFFFF is (almost) 1.0, so that a product of the two is
+ * a single high-half multiply.
+ */
+#define Q15_ONE 0x8000
+
+static inline uint16_t __to_q15(float x) {
+  // NOTE: max() must come first so that NaNs are flushed to zero
+  return static_cast<uint16_t>(fminf(fmaxf(32768.0f*x, 0.0f), 65535.0f));
+}
+
+static inline uint16_t __to_q16(float x) {
+  return static_cast<uint16_t>(fminf(fmaxf(65535.0f*x, 0.0f), 65535.0f));
+}
+
+static inline uint32_t __mulhi_q(uint32_t a, uint32_t b) { return (a*b) >> 16; }
+static inline uint32_t __adds_q(uint32_t a, uint32_t b) { return (a+b > 0xFFFF) ? 0xFFFF : a+b; }
+static inline uint32_t __subs_q(uint32_t a, uint32_t b) { return (a > b) ? a-b : 0; }
+
 void PixelBuffer::fill_rgb(float r, float g, float b) {
-  const float32x4_t RGB = (float32x4_t) {0.0f, b, g, r};
+  invalidate();
+  if (m_format == FIXED16) {
+    const uint16_t B = __to_q15(b), G = __to_q15(g), R = __to_q15(r);
+    const uint16_t rgb[8] = {0, B, G, R, 0, B, G, R};
+    const tsimd_u16x8 RGB = tsimd_load_u16(rgb);
+    int i = 0;
+    for (; i < (m_numLeds & ~0x1); i+=2) {
+      tsimd_store_u16(m_rgb16+4*i, RGB);
+    }
+    // an odd last pixel, as pixels past the end of the strip would count towards the power estimate
+    if (i < m_numLeds) memcpy(m_rgb16+4*i, rgb, 4*sizeof(uint16_t));
+    return;
+  }
+
+  if (m_format == PLANAR) {
+    const float x[3] = {r, g, b};
+    for (int k = 0; k < 3; ++k) {
+      float *const p = m_rgb + k*m_planeStride;
+      const tsimd_f32x4 X = tsimd_dup_f32(x[k]);
+      int i = 0;
+      for (; i < (m_numLeds & ~0x3); i+=4) tsimd_store_f32(p+i, X);
+      for (; i < m_numLeds; ++i) p[i] = x[k]; // nothing past the end of the strip, as for FIXED16
+    }
+    return;
+  }
+
+  const tsimd_f32x4 RGB = tsimd_set_f32(0.0f, b, g, r);
   for (int i = 0, j = 0; i < m_numLeds; i++, j+=4) {
-    vst1q_f32(m_rgb+j, RGB);
+    tsimd_store_f32(m_rgb+j, RGB);
   }
 }
 
 void PixelBuffer::apply_gain(float f) {
+  invalidate();
+  if (m_format == FIXED16) {
+    if (f <= 1.0f) {
+      const tsimd_u16x8 F = tsimd_dup_u16(__to_q16(f));
+      for (int i = 0; i < m_numRgbBytesTotal/2; i+=8) {
+        tsimd_store_u16(m_rgb16+i, tsimd_mulhi_u16(tsimd_load_u16(m_rgb16+i), F));
+      }
+    } else {
+      // gains above unity are rare, and saturate
+      for (int i = 0; i < 4*m_numLeds; ++i) {
+        m_rgb16[i] = static_cast<uint16_t>(fminf(f * m_rgb16[i], 65535.0f));
+      }
+    }
+    return;
+  }
+
+  if (m_format == PLANAR) {
+    // the padding is zero, and stays zero
+    for (int i = 0; i < 3*m_planeStride; i+=4) {
+      tsimd_store_f32(m_rgb+i, tsimd_mul_n_f32(tsimd_load_f32(m_rgb+i), f));
+    }
+    return;
+  }
+
   for (int i = 0, j = 0; i < m_numLeds; ++i, j+=4) {
-    float32x4_t x = vld1q_f32(m_rgb+j);
-    x = vmulq_n_f32(x, f);
-    vst1q_f32(m_rgb+j, x);
+    tsimd_f32x4 x = tsimd_load_f32(m_rgb+j);
+    x = tsimd_mul_n_f32(x, f);
+    tsimd_store_f32(m_rgb+j, x);
   }
 }
 
-uint8_t *PixelBuffer::prepareAndGetSpiBytes() {
-  const float32x4_t CLAMP_ONE = vdupq_n_f32(1.0f);
-  const float32x4_t CLAMP_ZERO = vdupq_n_f32(0.0f);
+/** How the encoders below apply gamma. */
+enum GammaMode {
+  GAMMA_TABLE, // look up the 8-bit table
+  GAMMA_POLY,  // evaluate the polynomial fitted to the 8-bit table. FIXED16 always looks up the table instead
+  GAMMA_HDR,   // look up the 16-bit table, and choose a brightness per pixel
+  GAMMA_SCALED, // look up the 16-bit table, and scale and/or dither its values
+};
 
-  // total brightness, _not_ including global
-  float32x4_t total = vdupq_n_f32(0.0f);
+/** The gamma curve as used by the encoders below. */
+typedef struct {
+  const uint8_t *table;
+  const uint16_t *table16;
+  // The polynomial in each lane (GLOBAL, BLUE, GREEN, RED) of the value before nightshift, scaled
+  // by gain. It is zero in the GLOBAL lanes. 0.5 is added to poly[0] so that truncation rounds.
+  tsimd_f32x4 poly[GAMMA_POLY_ORDER+1];
+  tsimd_f32x4 planePoly[3][GAMMA_POLY_ORDER+1]; // as poly, with the BLUE, GREEN and RED lane in all four lanes
+  tsimd_u16x8 ns16; // nightshift in Q0.16, for FIXED16. Zero in the GLOBAL lanes
+  tsimd_f32x4 scale16; // from table16 values to colour bytes, including the power limit gain, for GAMMA_SCALED
+  tsimd_f32x4 hdrScale; // from table16 values to brightness steps [0,31], including global and the power limit
+  float gain; // scales the colour bytes, for the power limit. [0,1]
+  float amps[4]; // the current per step of output in each lane (GLOBAL, BLUE, GREEN, RED). Steps are bytes, or brightness steps with GAMMA_HDR
+  tsimd_u8x16 global;
+  uint8_t G;
+  const uint8_t *spi; // the first LED frame
+  float *error; // the dithering error of each byte from spi onwards, or null. GAMMA_HDR and GAMMA_SCALED only
+} GammaEncoder;
 
-  // nightshift
-  float rw, gw, bw;
-  __kelvin_to_rgb(6600.0f*(1.0f-m_nightshift), &rw, &gw, &bw);
-  const float32x4_t ns = (float32x4_t) {
-      0.0f, // global
-      bw,   // blue
-      gw,   // green
-      rw    // red
-  };
-  uint8_t G = 0xE0 | static_cast<uint8_t>(m_global * 31.0f);
-  uint8x16_t GLOBAL = (uint8x16_t) {G,0,0,0,G,0,0,0,G,0,0,0,G,0,0,0};
-  for (int i = 0, j = 0; i < m_numLeds; i+=4, j+=16) {
-    float32x4_t x = vld1q_f32(m_rgb+j);
-    x = vmaxq_f32(x, CLAMP_ZERO); // clamp to [0,1]
-    x = vminq_f32(x, CLAMP_ONE);
-    x = vmulq_f32(x, ns); // apply nightshift
-    // apply gamma adjustment (based on lookup table)
-    // NOTE(mhroth): original LUT is roughly x**2.8 (==14/5). In this case we calculate x**3 as it is much
-    // easier and faster. The deviation is at most 7 steps darker.
-    x = vmulq_f32(x, vmulq_f32(x, x));
-    total = vaddq_f32(total, x); // keep track of total brightness
-    x = vmulq_n_f32(x, 255.0f);
-    uint16x4_t x_u16 = vmovn_u32(vcvtq_u32_f32(x));
-
-    float32x4_t y = vld1q_f32(m_rgb+j+4);
-    y = vmaxq_f32(vminq_f32(y, CLAMP_ONE), CLAMP_ZERO);
-    y = vmulq_f32(y, ns);
-    y = vmulq_f32(y, vmulq_f32(y, y));
-    total = vaddq_f32(total, y);
-    y = vmulq_n_f32(y, 255.0f);
-    uint16x4_t y_u16 = vmovn_u32(vcvtq_u32_f32(y));
-
-    uint8x8_t z_u8 = vmovn_u16(vcombine_u16(x_u16, y_u16));
-
-    float32x4_t a = vld1q_f32(m_rgb+j+8);
-    a = vmaxq_f32(vminq_f32(a, CLAMP_ONE), CLAMP_ZERO);
-    a = vmulq_f32(a, ns);
-    a = vmulq_f32(a, vmulq_f32(a, a));
-    total = vaddq_f32(total, a);
-    a = vmulq_n_f32(a, 255.0f);
-    uint16x4_t a_u16 = vmovn_u32(vcvtq_u32_f32(a));
-
-    float32x4_t b = vld1q_f32(m_rgb+j+12);
-    b = vmaxq_f32(vminq_f32(b, CLAMP_ONE), CLAMP_ZERO);
-    b = vmulq_f32(b, ns);
-    b = vmulq_f32(b, vmulq_f32(b, b));
-    total = vaddq_f32(total, b);
-    b = vmulq_n_f32(b, 255.0f);
-    uint16x4_t b_u16 = vmovn_u32(vcvtq_u32_f32(b));
-
-    uint8x8_t c_u8 = vmovn_u16(vcombine_u16(a_u16, b_u16));
-
-    uint8x16_t d_u8 = vorrq_u8(vcombine_u8(z_u8, c_u8), GLOBAL); // add global value into bytestream
-
-    // write to the spi_data buffer
-    vst1q_u8(m_spiData+4+j, d_u8);
-  }
-
-  // update current amperage usage
-  //                                 BLUE                       GREEN                      RED
-  m_currentAmps = m_global * .02f * (vgetq_lane_f32(total, 1) + vgetq_lane_f32(total, 2) + vgetq_lane_f32(total, 3));
-
-  // adjust global brightness if we are over the power limit
-  if (m_currentAmps > m_ampLimit) {
-    int8_t gf = static_cast<int8_t>(31.0f * m_global * m_ampLimit / m_currentAmps);
-    m_currentAmps = gf * m_currentAmps / (31.0f * m_global);
-
-    gf -= static_cast<int8_t>(G);
-
-    // go through the whole SPI buffer and update with the new global
-    int8x16_t GF = (int8x16_t) {gf,0,0,0,gf,0,0,0,gf,0,0,0,gf,0,0,0};
-    for (int i = 0, j = 0; i < m_numLeds; i+=4, j+=16) {
-      int8_t *const data = (int8_t *) (m_spiData + 4 + j);
-      vst1q_s8(data, vaddq_s8(vld1q_s8(data), GF));
-    }
-
-    m_isPowerSuppressionEngaged = true;
+/** Returns the dithering error of the four LED frames at spi. */
+static inline float *__dither_error(const GammaEncoder &gm, const uint8_t *spi) {
+  return gm.error + (spi - gm.spi);
+}
+
+/**
+ * Adds the error carried over from the last frame to four unrounded values, and clamps them to
+ * [0,256). Truncating the result leaves the new error, which is stored for the next frame.
+ */
+static inline tsimd_f32x4 __dither(tsimd_f32x4 y, float *error) {
+  y = tsimd_add_f32(y, tsimd_load_f32(error));
+  y = tsimd_min_f32(tsimd_max_f32(y, tsimd_dup_f32(0.0f)), tsimd_dup_f32(255.99f));
+  tsimd_store_f32(error, tsimd_sub_f32(y, tsimd_trunc_f32(y)));
+  return y;
+}
+
+/**
+ * Looks up four LEDs of 12-bit BLUE/GREEN/RED gamma table indices (the GLOBAL lanes are ignored)
+ * in the 8-bit table, writes their APA102 frames and returns the current drawn by their colour bytes.
+ */
+static inline float __gamma_gather(const uint16_t *idx, const GammaEncoder &gm, uint8_t *spi) {
+  uint8_t frames[16];
+  float total = 0.0f;
+  for (int k = 0; k < 16; k+=4) {
+    frames[k] = gm.G;
+    frames[k+1] = gm.table[idx[k+1]];
+    frames[k+2] = gm.table[idx[k+2]];
+    frames[k+3] = gm.table[idx[k+3]];
+    total += frames[k+1]*gm.amps[1] + frames[k+2]*gm.amps[2] + frames[k+3]*gm.amps[3];
+  }
+  // NOTE: one store, as byte stores into spi would alias idx and force it to be reloaded
+  memcpy(spi, frames, sizeof(frames));
+  return total;
+}
+
+/**
+ * As __gamma_gather() for one LED. Adds its colour bytes to bytes
+ * (BLUE, GREEN, RED) instead of returning the current, which is cheaper.
+ */
+static inline void __gamma_lookup(const uint16_t *idx, const uint8_t *table, uint8_t G, uint8_t *spi,
+    uint32_t *bytes) {
+  const uint8_t frame[4] = {G, table[idx[1]], table[idx[2]], table[idx[3]]};
+  bytes[0] += frame[1];
+  bytes[1] += frame[2];
+  bytes[2] += frame[3];
+  memcpy(spi, frame, sizeof(frame)); // one store
+}
+
+/** Evaluates the polynomial poly (see GammaEncoder) at x. */
+static inline tsimd_f32x4 __gamma_poly(tsimd_f32x4 x, const tsimd_f32x4 *poly) {
+  tsimd_f32x4 y = poly[GAMMA_POLY_ORDER];
+  for (int k = GAMMA_POLY_ORDER-1; k >= 0; --k) {
+    y = tsimd_madd_f32(poly[k], y, x);
+  }
+  return y;
+}
+
+/**
+ * Writes the APA102 frames of four GLOBAL/BLUE/GREEN/RED pixels, given their unrounded colour
+ * bytes from __gamma_poly() (zero in the GLOBAL lanes). The values are added to sum, see __gamma_sum().
+ */
+static inline void __poly_store(tsimd_f32x4 a, tsimd_f32x4 b, tsimd_f32x4 c, tsimd_f32x4 d,
+    const GammaEncoder &gm, uint8_t *spi, tsimd_f32x4 *sum) {
+  *sum = tsimd_add_f32(*sum, tsimd_add_f32(tsimd_add_f32(a, b), tsimd_add_f32(c, d)));
+  tsimd_store_u8(spi, tsimd_or_u8(tsimd_pack_u8(a, b, c, d), gm.global)); // add global value into bytestream
+}
+
+/** The number of LEDs that GAMMA_HDR and GAMMA_SCALED look up in one go. A multiple of 4. */
+#define STAGE_CHUNK 64
+
+/**
+ * LEDs waiting to be encoded with GAMMA_HDR or GAMMA_SCALED. The table lookups are batched, as a
+ * vector load of values that have just been stored one at a time would stall.
+ */
+typedef struct {
+  int n; // number of LEDs in idx
+  uint8_t *spi; // where the first LED in idx goes
+  uint16_t idx[3*STAGE_CHUNK+4]; // 16-bit gamma table indices, in groups of four BLUE, GREEN, RED
+} GammaStage;
+
+/**
+ * Encodes the staged LEDs, and adds the current that they draw to sum.
+ *
+ * With GAMMA_HDR each LED gets the smallest 5-bit brightness that can still show its brightest
+ * channel, and its colour bytes are scaled up to match. Dim LEDs thereby keep up to 8 bits of
+ * colour resolution, for about 13 bits in total. With GAMMA_SCALED the brightness is global.
+ */
+template <int MODE>
+static inline void __stage_flush(GammaStage *st, const GammaEncoder &gm, tsimd_f32x4 *sum) {
+  float lin[3*STAGE_CHUNK];
+  for (int k = 0; k < 3*st->n; ++k) lin[k] = gm.table16[st->idx[k]];
+
+  const tsimd_f32x4 scale = (MODE == GAMMA_HDR) ? gm.hdrScale : gm.scale16;
+  const tsimd_f32x4 HALF = tsimd_dup_f32(0.5f);
+  for (int k = 0; k < 3*st->n; k+=12, st->spi+=16) {
+    tsimd_f32x4 b = tsimd_mul_f32(tsimd_load_f32(lin+k),   scale);
+    tsimd_f32x4 g = tsimd_mul_f32(tsimd_load_f32(lin+k+4), scale);
+    tsimd_f32x4 r = tsimd_mul_f32(tsimd_load_f32(lin+k+8), scale);
+    *sum = tsimd_madd_f32(*sum, b, tsimd_dup_f32(gm.amps[1]));
+    *sum = tsimd_madd_f32(*sum, g, tsimd_dup_f32(gm.amps[2]));
+    *sum = tsimd_madd_f32(*sum, r, tsimd_dup_f32(gm.amps[3]));
+
+    tsimd_f32x4 br = tsimd_dup_f32(0.0f); // the global value is added when stored
+    if (MODE == GAMMA_HDR) {
+      // brightness is floor(max)+1, so that the colour bytes never overflow
+      const tsimd_f32x4 m = tsimd_max_f32(tsimd_max_f32(b, g), r);
+      br = tsimd_min_f32(tsimd_add_f32(tsimd_trunc_f32(m), tsimd_dup_f32(1.0f)), tsimd_dup_f32(31.0f));
+      const tsimd_f32x4 s = tsimd_div_f32(tsimd_dup_f32(255.0f), br);
+      b = tsimd_mul_f32(b, s);
+      g = tsimd_mul_f32(g, s);
+      r = tsimd_mul_f32(r, s);
+    }
+    if (gm.error != nullptr) {
+      float *const error = __dither_error(gm, st->spi); // planar, as staged
+      b = __dither(b, error);
+      g = __dither(g, error+4);
+      r = __dither(r, error+8);
+    } else {
+      b = tsimd_add_f32(b, HALF);
+      g = tsimd_add_f32(g, HALF);
+      r = tsimd_add_f32(r, HALF);
+    }
+
+    // planar to four interleaved GLOBAL, BLUE, GREEN, RED pixels
+    tsimd_transpose_f32(&br, &b, &g, &r);
+    tsimd_store_u8(st->spi, tsimd_or_u8(tsimd_pack_u8(br, b, g, r), gm.global));
+  }
+  st->n = 0;
+}
+
+/**
+ * Stages four LEDs for GAMMA_HDR or GAMMA_SCALED, given as planar BLUE, GREEN and RED values on
+ * [0,1] (after nightshift).
+ */
+template <int MODE>
+static inline void __stage(tsimd_f32x4 b, tsimd_f32x4 g, tsimd_f32x4 r,
+    const GammaEncoder &gm, GammaStage *st, tsimd_f32x4 *sum) {
+  const tsimd_f32x4 N = tsimd_dup_f32((float) (GAMMA_TABLE_SIZE-1));
+  const tsimd_f32x4 HALF = tsimd_dup_f32(0.5f);
+  uint16_t *idx = st->idx + 3*st->n;
+  tsimd_store_u16(idx,   tsimd_cvt_f32_u16(tsimd_madd_f32(HALF, b, N), tsimd_madd_f32(HALF, g, N)));
+  tsimd_store_u16(idx+8, tsimd_cvt_f32_u16(tsimd_madd_f32(HALF, r, N), HALF)); // the upper half is overwritten
+  st->n += 4;
+  if (st->n == STAGE_CHUNK) __stage_flush<MODE>(st, gm, sum);
+}
+
+/** As __stage(), for four LEDs of interleaved GLOBAL/BLUE/GREEN/RED gamma table indices. */
+template <int MODE>
+static inline void __stage_idx(const uint16_t *idx, const GammaEncoder &gm, GammaStage *st, tsimd_f32x4 *sum) {
+  uint16_t *const stage = st->idx + 3*st->n;
+  for (int k = 0; k < 4; ++k) {
+    stage[k]   = idx[4*k+1];
+    stage[k+4] = idx[4*k+2];
+    stage[k+8] = idx[4*k+3];
+  }
+  st->n += 4;
+  if (st->n == STAGE_CHUNK) __stage_flush<MODE>(st, gm, sum);
+}
+
+/**
+ * Applies gamma to four GLOBAL/BLUE/GREEN/RED pixels on [0,1] (after nightshift) with
+ * GAMMA_TABLE, and writes their APA102 frames to spi. Returns the current drawn by their colour
+ * bytes. With GAMMA_HDR and GAMMA_SCALED the pixels are staged in stage instead.
+ */
+template <int MODE>
+static inline float __gamma_encode(tsimd_f32x4 a, tsimd_f32x4 b, tsimd_f32x4 c, tsimd_f32x4 d,
+    const GammaEncoder &gm, uint8_t *spi, tsimd_f32x4 *sum, GammaStage *stage) {
+  if (MODE == GAMMA_HDR || MODE == GAMMA_SCALED) {
+    tsimd_transpose_f32(&a, &b, &c, &d); // to planar GLOBAL, BLUE, GREEN, RED
+    __stage<MODE>(b, c, d, gm, stage, sum);
+    return 0;
   } else {
-    m_isPowerSuppressionEngaged = false;
+    const tsimd_f32x4 N = tsimd_dup_f32((float) (GAMMA_TABLE_SIZE-1));
+    const tsimd_f32x4 HALF = tsimd_dup_f32(0.5f);
+    uint16_t idx[16];
+    tsimd_store_u16(idx,   tsimd_cvt_f32_u16(tsimd_madd_f32(HALF, a, N), tsimd_madd_f32(HALF, b, N)));
+    tsimd_store_u16(idx+8, tsimd_cvt_f32_u16(tsimd_madd_f32(HALF, c, N), tsimd_madd_f32(HALF, d, N)));
+    return __gamma_gather(idx, gm, spi);
+  }
+}
+
+/**
+ * Returns the current drawn by the colour bytes of numLeds LEDs, from the return values of
+ * __gamma_encode(), or from the per-lane sum of unrounded values of __poly_store() (lane 0 is
+ * always GLOBAL), or from the per-lane sum of currents of GAMMA_HDR and GAMMA_SCALED.
+ */
+template <int MODE>
+static inline float __gamma_sum(float exact, tsimd_f32x4 sum, int numLeds, const GammaEncoder &gm) {
+  if (MODE == GAMMA_TABLE) return exact;
+  if (MODE == GAMMA_HDR || MODE == GAMMA_SCALED) {
+    return tsimd_get_lane_f32(sum, 0) + tsimd_get_lane_f32(sum, 1)
+        + tsimd_get_lane_f32(sum, 2) + tsimd_get_lane_f32(sum, 3);
+  }
+  // every unrounded value is 0.5 too large, and the LEDs are processed four at a time
+  const float bias = 0.5f * ((numLeds + 3) & ~0x3);
+  return gm.amps[1] * (tsimd_get_lane_f32(sum, 1) - bias)
+      + gm.amps[2] * (tsimd_get_lane_f32(sum, 2) - bias)
+      + gm.amps[3] * (tsimd_get_lane_f32(sum, 3) - bias);
+}
+
+/** Clamps four values to [0,1]. */
+static inline tsimd_f32x4 __clamp_unit(tsimd_f32x4 x) {
+  // NOTE: max() must come first so that NaNs are flushed to zero on every backend
+  return tsimd_min_f32(tsimd_max_f32(x, tsimd_dup_f32(0.0f)), tsimd_dup_f32(1.0f));
+}
+
+// Encodes the FLOAT buffer into APA102 LED frames. Returns the current drawn (see __gamma_sum()).
+template <int MODE>
+static float __encode_f32(const float *rgb, int numLeds, uint8_t *spi, float rw, float gw, float bw,
+    const GammaEncoder &gm) {
+  const tsimd_f32x4 ns = tsimd_set_f32(0.0f, bw, gw, rw);
+  float exact = 0.0f;
+  tsimd_f32x4 sum = tsimd_dup_f32(0.0f);
+  GammaStage stage;
+  stage.n = 0;
+  stage.spi = spi;
+  for (int i = 0, j = 0; i < numLeds; i+=4, j+=16) {
+    const tsimd_f32x4 a = __clamp_unit(tsimd_load_f32(rgb+j));
+    const tsimd_f32x4 b = __clamp_unit(tsimd_load_f32(rgb+j+4));
+    const tsimd_f32x4 c = __clamp_unit(tsimd_load_f32(rgb+j+8));
+    const tsimd_f32x4 d = __clamp_unit(tsimd_load_f32(rgb+j+12));
+    if (MODE == GAMMA_POLY) {
+      // nightshift is part of the polynomial
+      __poly_store(__gamma_poly(a, gm.poly), __gamma_poly(b, gm.poly),
+          __gamma_poly(c, gm.poly), __gamma_poly(d, gm.poly), gm, spi+j, &sum);
+    } else {
+      exact += __gamma_encode<MODE>(tsimd_mul_f32(a, ns), tsimd_mul_f32(b, ns),
+          tsimd_mul_f32(c, ns), tsimd_mul_f32(d, ns), gm, spi+j, &sum, &stage);
+    }
+  }
+  if (MODE == GAMMA_HDR || MODE == GAMMA_SCALED) __stage_flush<MODE>(&stage, gm, &sum);
+  return __gamma_sum<MODE>(exact, sum, numLeds, gm);
+}
+
+// Encodes the PLANAR buffer into APA102 LED frames. Returns the current drawn (see __gamma_sum()).
+template <int MODE>
+static float __encode_planar(const float *r, const float *g, const float *b, int numLeds, uint8_t *spi,
+    float rw, float gw, float bw, const GammaEncoder &gm) {
+  const tsimd_f32x4 RW = tsimd_dup_f32(rw), GW = tsimd_dup_f32(gw), BW = tsimd_dup_f32(bw);
+  float exact = 0.0f;
+  tsimd_f32x4 sum = tsimd_dup_f32(0.0f);
+  GammaStage stage;
+  stage.n = 0;
+  stage.spi = spi;
+  for (int i = 0; i < numLeds; i+=4, spi+=16) {
+    tsimd_f32x4 p0 = tsimd_dup_f32(0.0f);
+    tsimd_f32x4 p1 = __clamp_unit(tsimd_load_f32(b+i));
+    tsimd_f32x4 p2 = __clamp_unit(tsimd_load_f32(g+i));
+    tsimd_f32x4 p3 = __clamp_unit(tsimd_load_f32(r+i));
+
+    if (MODE == GAMMA_POLY) {
+      // before interleaving, so that the GLOBAL lanes are not evaluated
+      p1 = __gamma_poly(p1, gm.planePoly[0]);
+      p2 = __gamma_poly(p2, gm.planePoly[1]);
+      p3 = __gamma_poly(p3, gm.planePoly[2]);
+      tsimd_transpose_f32(&p0, &p1, &p2, &p3);
+      __poly_store(p0, p1, p2, p3, gm, spi, &sum);
+    } else if (MODE == GAMMA_HDR || MODE == GAMMA_SCALED) {
+      __stage<MODE>(tsimd_mul_f32(p1, BW), tsimd_mul_f32(p2, GW), tsimd_mul_f32(p3, RW), gm, &stage, &sum);
+    } else {
+      p1 = tsimd_mul_f32(p1, BW); p2 = tsimd_mul_f32(p2, GW); p3 = tsimd_mul_f32(p3, RW);
+      // planar to four interleaved GLOBAL, BLUE, GREEN, RED pixels
+      tsimd_transpose_f32(&p0, &p1, &p2, &p3);
+      exact += __gamma_encode<MODE>(p0, p1, p2, p3, gm, spi, &sum, &stage);
+    }
+  }
+  if (MODE == GAMMA_HDR || MODE == GAMMA_SCALED) __stage_flush<MODE>(&stage, gm, &sum);
+  return __gamma_sum<MODE>(exact, sum, numLeds, gm);
+}
+
+/**
+ * Clamps two Q1.15 GLOBAL/BLUE/GREEN/RED pixels to [0,1], applies nightshift (Q0.16) and returns
+ * them as 12-bit gamma table indices. Nightshift leaves at most Q15_ONE-1, so the top 12 bits are an index.
+ */
+static inline tsimd_u16x8 __index_q15(tsimd_u16x8 x, tsimd_u16x8 ns) {
+  x = tsimd_mulhi_u16(tsimd_min_u16(x, tsimd_dup_u16(Q15_ONE)), ns);
+  return tsimd_shr_u16(x, 15 - 12);
+}
+
+// The number of LEDs whose gamma table indices __encode_q15() computes at a time.
+#define Q15_CHUNK 64
+
+// Encodes the FIXED16 buffer into APA102 LED frames. Returns the current drawn (see __gamma_sum()).
+// The gamma table is indexed straight from the Q1.15 values, with no conversion to float.
+template <int MODE>
+static float __encode_q15(const uint16_t *rgb, int numLeds, uint8_t *spi, const GammaEncoder &gm) {
+  // the 8-bit table is exact unless the bytes are scaled or dithered
+  const bool isExact = (MODE != GAMMA_SCALED && gm.gain == 1.0f);
+  const uint8_t *const table = gm.table;
+  const uint8_t G = gm.G;
+  tsimd_f32x4 sum = tsimd_dup_f32(0.0f);
+  GammaStage stage;
+  stage.n = 0;
+  stage.spi = spi;
+  uint32_t bytes[3] = {0, 0, 0}; // if isExact
+  uint16_t idx[4*Q15_CHUNK];
+  for (int i = 0; i < numLeds; i+=Q15_CHUNK) {
+    // all indices of a chunk first, so that the lookups load them rather than extract them from lanes
+    const int n = std::min(Q15_CHUNK, (numLeds-i+3) & ~3);
+    const uint16_t *const x = rgb + 4*i;
+    uint8_t *const d = spi + 4*i;
+    for (int k = 0; k < 4*n; k+=8) {
+      tsimd_store_u16(idx+k, __index_q15(tsimd_load_u16(x+k), gm.ns16));
+    }
+    if (MODE == GAMMA_HDR) {
+      for (int k = 0; k < 4*n; k+=16) __stage_idx<GAMMA_HDR>(idx+k, gm, &stage, &sum);
+    } else if (isExact) {
+      for (int k = 0; k < 4*n; k+=4) __gamma_lookup(idx+k, table, G, d+k, bytes);
+    } else {
+      for (int k = 0; k < 4*n; k+=16) __stage_idx<GAMMA_SCALED>(idx+k, gm, &stage, &sum);
+    }
+  }
+  if (MODE == GAMMA_HDR) {
+    __stage_flush<GAMMA_HDR>(&stage, gm, &sum);
+    return __gamma_sum<GAMMA_HDR>(0.0f, sum, numLeds, gm);
+  }
+  if (!isExact) {
+    __stage_flush<GAMMA_SCALED>(&stage, gm, &sum);
+    return __gamma_sum<GAMMA_SCALED>(0.0f, sum, numLeds, gm);
+  }
+  return bytes[0]*gm.amps[1] + bytes[1]*gm.amps[2] + bytes[2]*gm.amps[3];
+}
+
+// Encodes the numLeds LEDs from first (a multiple of 4) onwards. spi is the first LED frame of the strip.
+template <int MODE>
+static float __encode(PixelBuffer::Format format, const float *rgb, const uint16_t *rgb16, int planeStride,
+    int first, int numLeds, uint8_t *spi, float rw, float gw, float bw, const GammaEncoder &gm) {
+  spi += 4*first;
+  switch (format) {
+    default:
+    case PixelBuffer::FLOAT: return __encode_f32<MODE>(rgb+4*first, numLeds, spi, rw, gw, bw, gm);
+    case PixelBuffer::FIXED16: return __encode_q15<MODE>(rgb16+4*first, numLeds, spi, gm);
+    case PixelBuffer::PLANAR: {
+      rgb += first;
+      return __encode_planar<MODE>(rgb, rgb+planeStride, rgb+2*planeStride, numLeds, spi, rw, gw, bw, gm);
+    }
+  }
+}
+
+/** As __encode(), in the given GammaMode. */
+static float __encode(GammaMode mode, PixelBuffer::Format format, const float *rgb, const uint16_t *rgb16,
+    int planeStride, int first, int numLeds, uint8_t *spi, float rw, float gw, float bw, const GammaEncoder &gm) {
+  switch (mode) {
+    default:
+    case GAMMA_TABLE: return __encode<GAMMA_TABLE>(format, rgb, rgb16, planeStride, first, numLeds, spi, rw, gw, bw, gm);
+    case GAMMA_POLY: return __encode<GAMMA_POLY>(format, rgb, rgb16, planeStride, first, numLeds, spi, rw, gw, bw, gm);
+    case GAMMA_HDR: return __encode<GAMMA_HDR>(format, rgb, rgb16, planeStride, first, numLeds, spi, rw, gw, bw, gm);
+    case GAMMA_SCALED: return __encode<GAMMA_SCALED>(format, rgb, rgb16, planeStride, first, numLeds, spi, rw, gw, bw, gm);
+  }
+}
+
+/** Returns the current drawn by numLeds encoded LED frames, given the current of each channel. */
+static float __spi_amps(const uint8_t *spi, int numLeds, const float *channelAmps) {
+  // in integers, which can't overflow for fewer than 2**32 / (31*255) LEDs
+  uint32_t r = 0, g = 0, b = 0;
+  for (int i = 0; i < 4*numLeds; i+=4) {
+    const uint32_t brightness = spi[i] & 0x1F;
+    b += brightness * spi[i+1];
+    g += brightness * spi[i+2];
+    r += brightness * spi[i+3];
+  }
+  return (r*channelAmps[0] + g*channelAmps[1] + b*channelAmps[2]) / (31.0f * 255.0f);
+}
+
+void PixelBuffer::setGamma(float gamma) {
+  assert(gamma > 0.0f);
+  for (int i = 0; i < GAMMA_TABLE_SIZE; ++i) {
+    const float y = powf(i / (float) (GAMMA_TABLE_SIZE-1), gamma);
+    m_gamma[i] = static_cast<uint8_t>(255.0f * y + 0.5f);
+    m_gamma16[i] = static_cast<uint16_t>(65535.0f * y + 0.5f);
+  }
+  m_gammaExponent = gamma;
+  __fit_gamma_poly();
+  invalidate();
+}
+
+void PixelBuffer::setGammaTable(const uint8_t *table) {
+  assert(table != nullptr);
+  memcpy(m_gamma, table, GAMMA_TABLE_SIZE);
+  for (int i = 0; i < GAMMA_TABLE_SIZE; ++i) {
+    m_gamma16[i] = static_cast<uint16_t>(257 * table[i]); // 255 -> 65535
+  }
+  m_gammaExponent = 0.0f;
+  __fit_gamma_poly();
+  invalidate();
+}
+
+void PixelBuffer::__fit_gamma_poly() {
+  // least squares fit of the table, by way of the normal equations
+  const int N = GAMMA_POLY_ORDER+1;
+  double A[N][N+1];
+  memset(A, 0, sizeof(A));
+  for (int i = 0; i < GAMMA_TABLE_SIZE; ++i) {
+    const double x = i / (double) (GAMMA_TABLE_SIZE-1);
+    double p[N];
+    p[0] = 1.0;
+    for (int k = 1; k < N; ++k) p[k] = p[k-1] * x;
+    for (int r = 0; r < N; ++r) {
+      for (int c = 0; c < N; ++c) A[r][c] += p[r] * p[c];
+      A[r][N] += p[r] * m_gamma[i];
+    }
+  }
+
+  // Gauss-Jordan elimination with partial pivoting
+  for (int c = 0; c < N; ++c) {
+    int pivot = c;
+    for (int r = c+1; r < N; ++r) {
+      if (fabs(A[r][c]) > fabs(A[pivot][c])) pivot = r;
+    }
+    for (int k = 0; k <= N; ++k) std::swap(A[c][k], A[pivot][k]);
+    for (int r = 0; r < N; ++r) {
+      if (r == c) continue;
+      const double f = A[r][c] / A[c][c];
+      for (int k = c; k <= N; ++k) A[r][k] -= f * A[c][k];
+    }
+  }
+  for (int k = 0; k < N; ++k) m_gammaPoly[k] = static_cast<float>(A[k][N] / A[k][k]);
+
+  // The polynomial is only used if it rounds to within one step of every entry.
+  // This holds for power curves with exponents from about 1.8 upwards.
+  float maxError = 0.0f;
+  for (int i = 0; i < GAMMA_TABLE_SIZE; ++i) {
+    const float x = i / (float) (GAMMA_TABLE_SIZE-1);
+    float y = m_gammaPoly[GAMMA_POLY_ORDER];
+    for (int k = GAMMA_POLY_ORDER-1; k >= 0; --k) y = m_gammaPoly[k] + y*x;
+    maxError = fmaxf(maxError, fabsf(y - m_gamma[i]));
+  }
+  m_hasGammaPoly = (maxError < 0.75f);
+}
+
+uint8_t *PixelBuffer::prepareAndGetSpiBytes() {
+  // nightshift
+  const float rw = m_nightshiftRgb[0], gw = m_nightshiftRgb[1], bw = m_nightshiftRgb[2];
+
+  // The power limit scale comes from the last frame, so that the frame is encoded in one pass.
+  // Dim with the global brightness as far as it goes, and make up the rest (which is finer)
+  // by scaling the colour bytes.
+  const int global = static_cast<int>(m_global * 31.0f);
+  int brightness = global;
+  float gain = 1.0f;
+  if (m_powerScale < 1.0f && global > 0) {
+    const float target = global * m_powerScale;
+    brightness = static_cast<int>(ceilf(target));
+    gain = target / brightness;
+  }
+  const uint8_t G = 0xE0 | static_cast<uint8_t>(brightness);
+
+  GammaEncoder gm;
+  gm.table = m_gamma;
+  gm.table16 = m_gamma16;
+  // the polynomial of the value before nightshift, i.e. scale coefficient k by nightshift**k
+  const float ns[4] = {0.0f, bw, gw, rw};
+  float nsk[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  for (int k = 0; k <= GAMMA_POLY_ORDER; ++k) {
+    float c[4];
+    c[0] = 0.0f; // GLOBAL
+    for (int l = 1; l < 4; ++l) {
+      c[l] = gain * m_gammaPoly[k] * nsk[l] + ((k == 0) ? 0.5f : 0.0f);
+      nsk[l] *= ns[l];
+      gm.planePoly[l-1][k] = tsimd_dup_f32(c[l]);
+    }
+    gm.poly[k] = tsimd_set_f32(c[0], c[1], c[2], c[3]);
+  }
+  const uint16_t ns16[8] = {0, __to_q16(bw), __to_q16(gw), __to_q16(rw), 0, __to_q16(bw), __to_q16(gw), __to_q16(rw)};
+  gm.ns16 = tsimd_load_u16(ns16);
+  gm.scale16 = tsimd_dup_f32(gain * 255.0f / 65535.0f);
+  gm.hdrScale = tsimd_dup_f32(m_global * m_powerScale * 31.0f / 65535.0f);
+  gm.gain = gain;
+  // current per byte, or per brightness step with HDR
+  const float steps = m_hdr ? 31.0f : 255.0f;
+  gm.amps[0] = 0.0f;
+  gm.amps[1] = m_channelAmps[2] / steps;
+  gm.amps[2] = m_channelAmps[1] / steps;
+  gm.amps[3] = m_channelAmps[0] / steps;
+  gm.global = tsimd_dup_u8_lane0(m_hdr ? 0xE0 : G);
+  gm.G = G;
+  gm.spi = m_spiData+4;
+  gm.error = m_dither ? m_ditherError : nullptr;
+
+  // Dithering needs the exact colour bytes, and so does scaling them unless there is a polynomial
+  // (which is only accurate to the nearest byte). Those come from the 16-bit table.
+  GammaMode mode = m_hasGammaPoly ? GAMMA_POLY : GAMMA_TABLE;
+  if (m_hdr) {
+    mode = GAMMA_HDR;
+  } else if (m_dither || (mode == GAMMA_TABLE && gain < 1.0f)) {
+    mode = GAMMA_SCALED;
+  }
+
+  if (m_isEncodeStale || m_dither || m_powerScale != m_encodedPowerScale) {
+    // everything
+    const float amps = __encode(mode, m_format, m_rgb, m_rgb16, m_planeStride, 0, m_numLeds, m_spiData+4, rw, gw, bw, gm);
+    // with HDR, brightness is part of the colour bytes, so the current is already scaled by it
+    m_currentAmps = m_hdr ? amps : amps * brightness / 31.0f;
+    m_hasBlockAmps = false;
+  } else if (m_isDirty.load(std::memory_order_relaxed)) {
+    // only runs of dirty blocks
+    const int numBlocks = (m_numLeds+3)/4;
+    if (!m_hasBlockAmps) {
+      // the current of each block, so that it need not be read back from the SPI buffer
+      for (int k = 0; k < numBlocks; ++k) {
+        m_blockAmps[k] = __spi_amps(m_spiData + 4 + 16*k, std::min(4, m_numLeds - 4*k), m_channelAmps);
+      }
+      m_hasBlockAmps = true;
+    }
+    for (int b = 0; b < numBlocks; ) {
+      const uint8_t *d = (const uint8_t *) memchr(m_dirtyBlocks+b, 1, numBlocks-b);
+      if (d == nullptr) break;
+      b = static_cast<int>(d - m_dirtyBlocks);
+      int e = b+1;
+      while (e < numBlocks && m_dirtyBlocks[e]) ++e;
+
+      const int first = 4*b;
+      const int n = std::min(4*e, m_numLeds) - first;
+      __encode(mode, m_format, m_rgb, m_rgb16, m_planeStride, first, n, m_spiData+4, rw, gw, bw, gm);
+
+      // update the current with the difference that each block makes
+      for (int k = b; k < e; ++k) {
+        const float amps = __spi_amps(m_spiData + 4 + 16*k, std::min(4, m_numLeds - 4*k), m_channelAmps);
+        m_currentAmps += amps - m_blockAmps[k];
+        m_blockAmps[k] = amps;
+      }
+      b = e;
+    }
+    m_currentAmps = fmaxf(0.0f, m_currentAmps);
   }
+  if (m_isDirty.load(std::memory_order_relaxed)) memset(m_dirtyBlocks, 0, (m_numLeds+3)/4);
+  m_isDirty.store(false, std::memory_order_relaxed);
+  m_isEncodeStale = false;
+  m_encodedPowerScale = m_powerScale;
+
+  // update the power limit scale for the next frame, from what this frame would draw without it
+  m_isPowerSuppressionEngaged = (m_powerScale < 1.0f);
+  const float demand = m_currentAmps / m_powerScale;
+  const float target = (demand > m_ampLimit) ? m_ampLimit / demand : 1.0f;
+  m_powerScale += ((target < m_powerScale) ? m_powerAttack : m_powerRelease) * (target - m_powerScale);
+  if (fabsf(target - m_powerScale) < 0.001f) m_powerScale = target; // otherwise release never quite reaches 1
 
   // clear trailing bytes, as above loop may have overwriten some
   memset(m_spiData + (4*(m_numLeds+1)), 0xFF, m_numSpiTrailerBytes);
@@ -220,6 +839,52 @@ uint8_t *PixelBuffer::prepareAndGetSpiBytes() {
   return m_spiData;
 }
 
+// Blends one float channel value, as set_pixel_rgb_blend() does for FLOAT.
+static inline float __blend_f32(PixelBuffer::BlendMode mode, float d, float s, float a) {
+  switch (mode) {
+    default:
+    case PixelBuffer::SET: return s;
+    case PixelBuffer::ADD: return a*s + (1.0f-a)*d;
+    case PixelBuffer::ACCUMULATE: return d + a*s;
+    case PixelBuffer::DIFFERENCE: return a*fabsf(s-d) + (1.0f-a)*d;
+    case PixelBuffer::MULTIPLY: return a*(d*s) + (1.0f-a)*d;
+    case PixelBuffer::SCREEN: return 1.0f - s*d;
+  }
+}
+
+// Blends one Q1.15 channel value. a is Q0.16 and z is (0xFFFF-a).
+// For ACCUMULATE, s must already have been multiplied by a (which may be larger than 1).
+static inline uint16_t __blend_q15(PixelBuffer::BlendMode mode, uint32_t d, uint32_t s, uint32_t a, uint32_t z) {
+  switch (mode) {
+    default:
+    case PixelBuffer::SET: return s;
+    case PixelBuffer::ADD: return __adds_q(__mulhi_q(a, s), __mulhi_q(z, d));
+    case PixelBuffer::ACCUMULATE: return __adds_q(d, s);
+    case PixelBuffer::DIFFERENCE: {
+      return __adds_q(__mulhi_q(a, (s > d) ? s-d : d-s), __mulhi_q(z, d));
+    }
+    case PixelBuffer::MULTIPLY: {
+      const uint32_t m = __mulhi_q(d, s);
+      return __adds_q(__mulhi_q(a, __adds_q(m, m)), __mulhi_q(z, d));
+    }
+    case PixelBuffer::SCREEN: {
+      const uint32_t m = __mulhi_q(s, d);
+      return __subs_q(Q15_ONE, __adds_q(m, m));
+    }
+  }
+}
+
+static void __set_pixel_q15(uint16_t *p, float r, float g, float b, float a, PixelBuffer::BlendMode mode) {
+  if (mode == PixelBuffer::ACCUMULATE) {
+    r *= a; g *= a; b *= a;
+  }
+  const uint32_t A = __to_q16(a);
+  const uint32_t Z = 0xFFFF - A;
+  p[3] = __blend_q15(mode, p[3], __to_q15(r), A, Z);
+  p[2] = __blend_q15(mode, p[2], __to_q15(g), A, Z);
+  p[1] = __blend_q15(mode, p[1], __to_q15(b), A, Z);
+}
+
 void PixelBuffer::set_pixel_rgb_blend(int i, float r, float g, float b, float a, BlendMode mode) {
   assert(i >= 0 && i < m_numLeds);
 
@@ -229,8 +894,26 @@ void PixelBuffer::set_pixel_rgb_blend(int i, float r, float g, float b, float a,
   assert(isfinite(b) && "b is NaN.");
   assert(isfinite(a) && "a is NaN.");
 
+  // in release builds, drop writes outside of the strip (e.g. an index computed from NaN),
+  // rather than mark a dirty block far outside of m_dirtyBlocks
+  if ((unsigned) i >= (unsigned) m_numLeds) return;
+
+  m_dirtyBlocks[i >> 2] = 1;
+  m_isDirty.store(true, std::memory_order_relaxed);
+
   const int j = 4 * i;
 
+  if (m_format == FIXED16) {
+    __set_pixel_q15(m_rgb16+j, r, g, b, a, mode);
+    return;
+  } else if (m_format == PLANAR) {
+    float *const p = m_rgb + i;
+    p[0]               = __blend_f32(mode, p[0],               r, a);
+    p[m_planeStride]   = __blend_f32(mode, p[m_planeStride],   g, a);
+    p[2*m_planeStride] = __blend_f32(mode, p[2*m_planeStride], b, a);
+    return;
+  }
+
   switch (mode) {
     default:
     case SET: {
@@ -251,7 +934,7 @@ void PixelBuffer::set_pixel_rgb_blend(int i, float r, float g, float b, float a,
       break;
     }
     case MULTIPLY: {
-      set_pixel_rgb_blend(i, m_rgb[j+3]*r, m_rgb[j+2]*g, m_rgb[j+1]*g, a, BlendMode::ADD);
+      set_pixel_rgb_blend(i, m_rgb[j+3]*r, m_rgb[j+2]*g, m_rgb[j+1]*b, a, BlendMode::ADD);
       break;
     }
     case SCREEN: {
@@ -261,8 +944,200 @@ void PixelBuffer::set_pixel_rgb_blend(int i, float r, float g, float b, float a,
   }
 }
 
+// Per-channel blend operations, four channel values at a time. See set_pixel_rgb_blend().
+// z is (1-a).
+template <PixelBuffer::BlendMode M>
+static inline tsimd_f32x4 __blend(tsimd_f32x4 d, tsimd_f32x4 s, tsimd_f32x4 a, tsimd_f32x4 z) {
+  switch (M) {
+    default:
+    case PixelBuffer::SET: return s;
+    case PixelBuffer::ADD: return tsimd_add_f32(tsimd_mul_f32(a, s), tsimd_mul_f32(z, d));
+    case PixelBuffer::ACCUMULATE: return tsimd_add_f32(d, tsimd_mul_f32(a, s));
+    case PixelBuffer::DIFFERENCE: {
+      return tsimd_add_f32(tsimd_mul_f32(a, tsimd_abs_f32(tsimd_sub_f32(s, d))), tsimd_mul_f32(z, d));
+    }
+    case PixelBuffer::MULTIPLY: return tsimd_add_f32(tsimd_mul_f32(a, tsimd_mul_f32(d, s)), tsimd_mul_f32(z, d));
+    case PixelBuffer::SCREEN: return tsimd_sub_f32(tsimd_dup_f32(1.0f), tsimd_mul_f32(s, d));
+  }
+}
+
+// Blends n pixels (a multiple of 4) of planar RGBA data into the interleaved buffer rgb.
+template <PixelBuffer::BlendMode M>
+static void __blend_span_kernel(float *rgb, int n,
+    const float *r, const float *g, const float *b, const float *a, float aConst) {
+  const tsimd_f32x4 ONE = tsimd_dup_f32(1.0f);
+  tsimd_f32x4 va = tsimd_dup_f32(aConst);
+  tsimd_f32x4 vz = tsimd_sub_f32(ONE, va);
+  for (int k = 0; k < n; k+=4, rgb+=16) {
+    if (a != nullptr) {
+      va = tsimd_load_f32(a+k);
+      vz = tsimd_sub_f32(ONE, va);
+    }
+
+    // four interleaved pixels to planar GLOBAL, BLUE, GREEN, RED
+    tsimd_f32x4 p0 = tsimd_load_f32(rgb);
+    tsimd_f32x4 p1 = tsimd_load_f32(rgb+4);
+    tsimd_f32x4 p2 = tsimd_load_f32(rgb+8);
+    tsimd_f32x4 p3 = tsimd_load_f32(rgb+12);
+    tsimd_transpose_f32(&p0, &p1, &p2, &p3);
+
+    p1 = __blend<M>(p1, tsimd_load_f32(b+k), va, vz);
+    p2 = __blend<M>(p2, tsimd_load_f32(g+k), va, vz);
+    p3 = __blend<M>(p3, tsimd_load_f32(r+k), va, vz);
+
+    tsimd_transpose_f32(&p0, &p1, &p2, &p3);
+    tsimd_store_f32(rgb, p0);
+    tsimd_store_f32(rgb+4, p1);
+    tsimd_store_f32(rgb+8, p2);
+    tsimd_store_f32(rgb+12, p3);
+  }
+}
+
+// As __blend(), for two Q1.15 pixels at a time. See __blend_q15().
+template <PixelBuffer::BlendMode M>
+static inline tsimd_u16x8 __blend_u16(tsimd_u16x8 d, tsimd_u16x8 s, tsimd_u16x8 a, tsimd_u16x8 z) {
+  switch (M) {
+    default:
+    case PixelBuffer::SET: return s;
+    case PixelBuffer::ADD: return tsimd_adds_u16(tsimd_mulhi_u16(a, s), tsimd_mulhi_u16(z, d));
+    case PixelBuffer::ACCUMULATE: return tsimd_adds_u16(d, s);
+    case PixelBuffer::DIFFERENCE: {
+      return tsimd_adds_u16(tsimd_mulhi_u16(a, tsimd_absdiff_u16(s, d)), tsimd_mulhi_u16(z, d));
+    }
+    case PixelBuffer::MULTIPLY: {
+      const tsimd_u16x8 m = tsimd_mulhi_u16(d, s);
+      return tsimd_adds_u16(tsimd_mulhi_u16(a, tsimd_adds_u16(m, m)), tsimd_mulhi_u16(z, d));
+    }
+    case PixelBuffer::SCREEN: {
+      const tsimd_u16x8 m = tsimd_mulhi_u16(s, d);
+      return tsimd_subs_u16(tsimd_dup_u16(Q15_ONE), tsimd_adds_u16(m, m));
+    }
+  }
+}
+
+// As __blend_span_kernel(), into a Q1.15 buffer.
+template <PixelBuffer::BlendMode M>
+static void __blend_span_kernel_q15(uint16_t *rgb, int n,
+    const float *r, const float *g, const float *b, const float *a, float aConst) {
+  const tsimd_f32x4 Q15 = tsimd_dup_f32(32768.0f);
+  const tsimd_f32x4 Q16 = tsimd_dup_f32(65535.0f);
+  const tsimd_u16x8 MAX = tsimd_dup_u16(0xFFFF);
+  tsimd_f32x4 va = tsimd_dup_f32(aConst);
+  tsimd_u16x8 a01 = tsimd_dup_u16(__to_q16(aConst)), a23 = a01;
+  tsimd_u16x8 z01 = tsimd_subs_u16(MAX, a01), z23 = z01;
+  for (int k = 0; k < n; k+=4, rgb+=16) {
+    tsimd_f32x4 p0 = tsimd_dup_f32(0.0f);
+    tsimd_f32x4 p1 = tsimd_mul_f32(tsimd_load_f32(b+k), Q15);
+    tsimd_f32x4 p2 = tsimd_mul_f32(tsimd_load_f32(g+k), Q15);
+    tsimd_f32x4 p3 = tsimd_mul_f32(tsimd_load_f32(r+k), Q15);
+
+    if (M == PixelBuffer::ACCUMULATE) {
+      // alpha may be larger than one, so apply it before conversion
+      if (a != nullptr) va = tsimd_load_f32(a+k);
+      p1 = tsimd_mul_f32(p1, va); p2 = tsimd_mul_f32(p2, va); p3 = tsimd_mul_f32(p3, va);
+    } else if (a != nullptr && M != PixelBuffer::SET && M != PixelBuffer::SCREEN) {
+      // broadcast each pixel's alpha across its four channels
+      tsimd_f32x4 q0 = tsimd_mul_f32(tsimd_load_f32(a+k), Q16), q1 = q0, q2 = q0, q3 = q0;
+      tsimd_transpose_f32(&q0, &q1, &q2, &q3);
+      a01 = tsimd_cvt_f32_u16(q0, q1); z01 = tsimd_subs_u16(MAX, a01);
+      a23 = tsimd_cvt_f32_u16(q2, q3); z23 = tsimd_subs_u16(MAX, a23);
+    }
+
+    // planar BLUE, GREEN, RED to four interleaved pixels
+    tsimd_transpose_f32(&p0, &p1, &p2, &p3);
+    const tsimd_u16x8 s01 = tsimd_cvt_f32_u16(p0, p1);
+    const tsimd_u16x8 s23 = tsimd_cvt_f32_u16(p2, p3);
+
+    // the global lanes are blended too, but are ignored by the encoder
+    tsimd_store_u16(rgb,   __blend_u16<M>(tsimd_load_u16(rgb),   s01, a01, z01));
+    tsimd_store_u16(rgb+8, __blend_u16<M>(tsimd_load_u16(rgb+8), s23, a23, z23));
+  }
+}
+
+// As __blend_span_kernel(), into the PLANAR buffer. No shuffling is necessary.
+template <PixelBuffer::BlendMode M>
+static void __blend_span_kernel_planar(float *dr, float *dg, float *db, int n,
+    const float *r, const float *g, const float *b, const float *a, float aConst) {
+  const tsimd_f32x4 ONE = tsimd_dup_f32(1.0f);
+  tsimd_f32x4 va = tsimd_dup_f32(aConst);
+  tsimd_f32x4 vz = tsimd_sub_f32(ONE, va);
+  for (int k = 0; k < n; k+=4) {
+    if (a != nullptr) {
+      va = tsimd_load_f32(a+k);
+      vz = tsimd_sub_f32(ONE, va);
+    }
+    tsimd_store_f32(dr+k, __blend<M>(tsimd_load_f32(dr+k), tsimd_load_f32(r+k), va, vz));
+    tsimd_store_f32(dg+k, __blend<M>(tsimd_load_f32(dg+k), tsimd_load_f32(g+k), va, vz));
+    tsimd_store_f32(db+k, __blend<M>(tsimd_load_f32(db+k), tsimd_load_f32(b+k), va, vz));
+  }
+}
+
+void PixelBuffer::__blend_span(int i, int n,
+    const float *r, const float *g, const float *b, const float *a, float aConst, BlendMode mode) {
+  assert(i >= 0 && n >= 0 && i+n <= m_numLeds);
+  assert(r != nullptr && g != nullptr && b != nullptr);
+
+  if (n == 0) return;
+  memset(m_dirtyBlocks + (i >> 2), 1, ((i+n-1) >> 2) - (i >> 2) + 1);
+  m_isDirty.store(true, std::memory_order_relaxed);
+
+  const int n4 = n & ~0x3;
+  if (m_format == FIXED16) {
+    uint16_t *const rgb = m_rgb16 + 4*i;
+    switch (mode) {
+      default:
+      case SET: __blend_span_kernel_q15<SET>(rgb, n4, r, g, b, a, aConst); break;
+      case ADD: __blend_span_kernel_q15<ADD>(rgb, n4, r, g, b, a, aConst); break;
+      case ACCUMULATE: __blend_span_kernel_q15<ACCUMULATE>(rgb, n4, r, g, b, a, aConst); break;
+      case DIFFERENCE: __blend_span_kernel_q15<DIFFERENCE>(rgb, n4, r, g, b, a, aConst); break;
+      case MULTIPLY: __blend_span_kernel_q15<MULTIPLY>(rgb, n4, r, g, b, a, aConst); break;
+      case SCREEN: __blend_span_kernel_q15<SCREEN>(rgb, n4, r, g, b, a, aConst); break;
+    }
+  } else if (m_format == PLANAR) {
+    float *const dr = m_rgb + i;
+    float *const dg = dr + m_planeStride;
+    float *const db = dg + m_planeStride;
+    switch (mode) {
+      default:
+      case SET: __blend_span_kernel_planar<SET>(dr, dg, db, n4, r, g, b, a, aConst); break;
+      case ADD: __blend_span_kernel_planar<ADD>(dr, dg, db, n4, r, g, b, a, aConst); break;
+      case ACCUMULATE: __blend_span_kernel_planar<ACCUMULATE>(dr, dg, db, n4, r, g, b, a, aConst); break;
+      case DIFFERENCE: __blend_span_kernel_planar<DIFFERENCE>(dr, dg, db, n4, r, g, b, a, aConst); break;
+      case MULTIPLY: __blend_span_kernel_planar<MULTIPLY>(dr, dg, db, n4, r, g, b, a, aConst); break;
+      case SCREEN: __blend_span_kernel_planar<SCREEN>(dr, dg, db, n4, r, g, b, a, aConst); break;
+    }
+  } else {
+    float *const rgb = m_rgb + 4*i;
+    switch (mode) {
+      default:
+      case SET: __blend_span_kernel<SET>(rgb, n4, r, g, b, a, aConst); break;
+      case ADD: __blend_span_kernel<ADD>(rgb, n4, r, g, b, a, aConst); break;
+      case ACCUMULATE: __blend_span_kernel<ACCUMULATE>(rgb, n4, r, g, b, a, aConst); break;
+      case DIFFERENCE: __blend_span_kernel<DIFFERENCE>(rgb, n4, r, g, b, a, aConst); break;
+      case MULTIPLY: __blend_span_kernel<MULTIPLY>(rgb, n4, r, g, b, a, aConst); break;
+      case SCREEN: __blend_span_kernel<SCREEN>(rgb, n4, r, g, b, a, aConst); break;
+    }
+  }
+
+  // remainder
+  for (int k = n4; k < n; ++k) {
+    set_pixel_rgb_blend(i+k, r[k], g[k], b[k], (a != nullptr) ? a[k] : aConst, mode);
+  }
+}
+
+void PixelBuffer::set_span_rgb_blend(int i, int n,
+    const float *r, const float *g, const float *b, const float *a, BlendMode mode) {
+  assert(a != nullptr);
+  __blend_span(i, n, r, g, b, a, 1.0f, mode);
+}
+
+void PixelBuffer::set_span_rgb_blend(int i, int n,
+    const float *r, const float *g, const float *b, float a, BlendMode mode) {
+  __blend_span(i, n, r, g, b, nullptr, a, mode);
+}
+
 // http://www.rapidtables.com/convert/color/hsl-to-rgb.htm
-void PixelBuffer::set_pixel_hsl_blend(int i, float h, float s, float l, float a, BlendMode mode) {
+static inline void __hsl_to_rgb(float h, float s, float l, float *r, float *g, float *b) {
   // wrap hue around [0,360]
   if (h < 0.0f) h += 360.0f;
   else if (h > 360.0f) h -= 360.0f;
@@ -273,35 +1148,38 @@ void PixelBuffer::set_pixel_hsl_blend(int i, float h, float s, float l, float a,
   float X = ((((int) (h/60.0f)) % 2) == 0) ? C : 0.0f;
   float m = l - C*0.5f;
 
-  float r, g, b;
   if (h < 60.0f) {
-    r = C+m; g = X+m; b = 0.0f+m;
+    *r = C+m; *g = X+m; *b = 0.0f+m;
   } else if (h < 120.0f) {
-    r = X+m; g = C+m; b = 0.0f+m;
+    *r = X+m; *g = C+m; *b = 0.0f+m;
   } else if (h < 180.0f) {
-    r = 0.0f+m; g = C+m; b = X+m;
+    *r = 0.0f+m; *g = C+m; *b = X+m;
   } else if (h < 240.0f) {
-    r = 0.0f+m; g = X+m; b = C+m;
+    *r = 0.0f+m; *g = X+m; *b = C+m;
   } else if (h < 300.0f) {
-    r = X+m; g = 0.0f+m; b = C+m;
+    *r = X+m; *g = 0.0f+m; *b = C+m;
   } else {
-    r = C+m; g = 0.0f+m; b = X+m;
+    *r = C+m; *g = 0.0f+m; *b = X+m;
   }
+}
 
+void PixelBuffer::set_pixel_hsl_blend(int i, float h, float s, float l, float a, BlendMode mode) {
+  float r, g, b;
+  __hsl_to_rgb(h, s, l, &r, &g, &b);
   set_pixel_rgb_blend(i, r, g, b, a, mode);
 }
 
-void PixelBuffer::set_pixel_mhroth_hsl_blend(int i, float h, float s, float l, float a, BlendMode mode) {
+#define M_PI_3 1.047197551196598f // 60 deg
+#define M_PI_2_3 2.094395102393195f // 120 deg
+#define L_HEIGHT 0.408248290463863f // (SQRT_2/2)*tan(30deg)
+
+static inline void __mhroth_hsl_to_rgb(float h, float s, float l, float *_r, float *_g, float *_b) {
   // wrap hue around [-180,180]
   if (h < -180.0f) h += 360.0f;
   else if (h > 180.0f) h -= 360.0f;
   s = fmaxf(0.0f, fminf(1.0f, s));
   l = fmaxf(0.0f, fminf(1.0f, l));
 
-#define M_PI_3 1.047197551196598f // 60 deg
-#define M_PI_2_3 2.094395102393195f // 120 deg
-#define L_HEIGHT 0.408248290463863f // (SQRT_2/2)*tan(30deg)
-
   // rescale hue, saturation, and lightness
   h *= 0.017453292519943f; // M_PI/180.0f;
   l *= 1.732050807568877f; // sqrtf(3.0f);
@@ -345,9 +1223,255 @@ void PixelBuffer::set_pixel_mhroth_hsl_blend(int i, float h, float s, float l, f
   float b = z - y - x;
 
   // clamp result
-  r = fmaxf(0.0f, fminf(1.0f, r));
-  g = fmaxf(0.0f, fminf(1.0f, g));
-  b = fmaxf(0.0f, fminf(1.0f, b));
+  *_r = fmaxf(0.0f, fminf(1.0f, r));
+  *_g = fmaxf(0.0f, fminf(1.0f, g));
+  *_b = fmaxf(0.0f, fminf(1.0f, b));
+}
+
+// The mhroth LUT samples __mhroth_hsl_to_rgb() on a regular (hue, saturation, lightness) grid.
+// Hue covers [-180,180] and includes both endpoints so that interpolation wraps cleanly.
+// The colour model is discontinuous at lightness 1/3 and 2/3 (where the cube clipping
+// begins), so lightness is split into three segments that each have their own endpoints.
+#define LUT_NUM_H 64
+#define LUT_NUM_S 17
+#define LUT_NUM_L_SEG 11
+#define LUT_NUM_L (3*LUT_NUM_L_SEG)
+#define LUT_INDEX(ih, is, il) (4*(((ih)*LUT_NUM_S + (is))*LUT_NUM_L + (il)))
+
+static float *MHROTH_LUT = nullptr; // (LUT_NUM_H+1)*LUT_NUM_S*LUT_NUM_L BGR pixels, ~580KB
+static pthread_once_t MHROTH_LUT_ONCE = PTHREAD_ONCE_INIT;
 
+static void __build_mhroth_lut_once() {
+  MHROTH_LUT = (float *) malloc(LUT_INDEX(LUT_NUM_H+1, 0, 0) * sizeof(float));
+  assert(MHROTH_LUT != nullptr);
+  for (int ih = 0; ih <= LUT_NUM_H; ++ih) {
+    const float h = -180.0f + (360.0f*ih)/LUT_NUM_H;
+    for (int is = 0; is < LUT_NUM_S; ++is) {
+      const float s = ((float) is)/(LUT_NUM_S-1);
+      for (int il = 0; il < LUT_NUM_L; ++il) {
+        const int seg = il / LUT_NUM_L_SEG;
+        float l = (seg + ((float) (il % LUT_NUM_L_SEG))/(LUT_NUM_L_SEG-1)) / 3.0f;
+        // approach each discontinuity from inside the segment
+        if (il == LUT_NUM_L_SEG-1) l -= 1e-6f;
+        else if (il == 2*LUT_NUM_L_SEG) l += 1e-6f;
+        float r, g, b;
+        __mhroth_hsl_to_rgb(h, s, l, &r, &g, &b);
+        float *x = MHROTH_LUT + LUT_INDEX(ih, is, il);
+        x[0] = 0.0f; x[1] = b; x[2] = g; x[3] = r; // same order as m_rgb
+      }
+    }
+  }
+}
+
+void PixelBuffer::__build_mhroth_lut() {
+  // the table only depends on the colour model, so it is shared by all instances
+  pthread_once(&MHROTH_LUT_ONCE, &__build_mhroth_lut_once);
+}
+
+static inline tsimd_f32x4 __lerp(tsimd_f32x4 a, tsimd_f32x4 b, float t) {
+  return tsimd_add_f32(a, tsimd_mul_n_f32(tsimd_sub_f32(b, a), t));
+}
+
+/** Looks up and interpolates one LUT cell. */
+static inline tsimd_f32x4 __mhroth_lut_cell(int index, float th, float ts, float tl) {
+  const float *x = MHROTH_LUT + index;
+  const int dh = LUT_INDEX(1, 0, 0), ds = LUT_INDEX(0, 1, 0), dl = LUT_INDEX(0, 0, 1);
+  const tsimd_f32x4 c00 = __lerp(tsimd_load_f32(x),       tsimd_load_f32(x+dl),       tl);
+  const tsimd_f32x4 c01 = __lerp(tsimd_load_f32(x+ds),    tsimd_load_f32(x+ds+dl),    tl);
+  const tsimd_f32x4 c10 = __lerp(tsimd_load_f32(x+dh),    tsimd_load_f32(x+dh+dl),    tl);
+  const tsimd_f32x4 c11 = __lerp(tsimd_load_f32(x+dh+ds), tsimd_load_f32(x+dh+ds+dl), tl);
+  return __lerp(__lerp(c00, c01, ts), __lerp(c10, c11, ts), th);
+}
+
+/**
+ * Trilinear interpolation of the mhroth LUT. The mean error is below 0.1% of full scale,
+ * the worst case (where saturation reaches the edge of the cube) is about 4%.
+ */
+static inline void __mhroth_hsl_to_rgb_lut(float h, float s, float l, float *r, float *g, float *b) {
+  float fh = (h + 180.0f) * (LUT_NUM_H/360.0f);
+  if (fh < 0.0f) fh += LUT_NUM_H; else if (fh >= LUT_NUM_H) fh -= LUT_NUM_H;
+  const float fs = fminf(fmaxf(s, 0.0f), 1.0f) * (LUT_NUM_S-1);
+  l = fminf(fmaxf(l, 0.0f), 1.0f);
+  const int seg = (l < 0.333333333f) ? 0 : (l > 0.666666667f) ? 2 : 1;
+  const float fl = (3.0f*l - seg) * (LUT_NUM_L_SEG-1);
+  int ih = (int) fh; if (ih > LUT_NUM_H-1) ih = LUT_NUM_H-1; else if (ih < 0) ih = 0;
+  int is = (int) fs; if (is > LUT_NUM_S-2) is = LUT_NUM_S-2;
+  int il = (int) fl; if (il > LUT_NUM_L_SEG-2) il = LUT_NUM_L_SEG-2; else if (il < 0) il = 0;
+
+  const tsimd_f32x4 c = __mhroth_lut_cell(LUT_INDEX(ih, is, seg*LUT_NUM_L_SEG + il), fh - ih, fs - is, fl - il);
+  *b = tsimd_get_lane_f32(c, 1);
+  *g = tsimd_get_lane_f32(c, 2);
+  *r = tsimd_get_lane_f32(c, 3);
+}
+
+void PixelBuffer::set_pixel_mhroth_hsl_blend(int i, float h, float s, float l, float a, BlendMode mode) {
+  float r, g, b;
+  if (m_useMhrothLut) __mhroth_hsl_to_rgb_lut(h, s, l, &r, &g, &b);
+  else __mhroth_hsl_to_rgb(h, s, l, &r, &g, &b);
   set_pixel_rgb_blend(i, r, g, b, a, mode);
 }
+
+
+static inline tsimd_f32x4 __clamp01(tsimd_f32x4 x) {
+  return tsimd_min_f32(tsimd_max_f32(x, tsimd_dup_f32(0.0f)), tsimd_dup_f32(1.0f));
+}
+
+/** Four-wide version of __hsl_to_rgb(). The sector branches become nested selects. */
+static void __hsl_to_rgb_span(int n, const float *h, const float *s, const float *l, float *r, float *g, float *b) {
+  const tsimd_f32x4 zero = tsimd_dup_f32(0.0f);
+  int k = 0;
+  for (; k <= n-4; k+=4) {
+    tsimd_f32x4 H = tsimd_load_f32(h+k);
+    H = tsimd_select_f32(tsimd_lt_f32(H, zero), tsimd_add_f32(H, tsimd_dup_f32(360.0f)),
+        tsimd_select_f32(tsimd_gt_f32(H, tsimd_dup_f32(360.0f)), tsimd_sub_f32(H, tsimd_dup_f32(360.0f)), H));
+    const tsimd_f32x4 S = __clamp01(tsimd_load_f32(s+k));
+    const tsimd_f32x4 L = __clamp01(tsimd_load_f32(l+k));
+
+    const tsimd_f32x4 C = tsimd_mul_f32(tsimd_sub_f32(tsimd_dup_f32(1.0f),
+        tsimd_abs_f32(tsimd_sub_f32(tsimd_mul_n_f32(L, 2.0f), tsimd_dup_f32(1.0f)))), S);
+    const tsimd_f32x4 sector = tsimd_trunc_f32(tsimd_div_f32(H, tsimd_dup_f32(60.0f)));
+    const tsimd_f32x4 parity = tsimd_sub_f32(sector, tsimd_mul_n_f32(tsimd_trunc_f32(tsimd_mul_n_f32(sector, 0.5f)), 2.0f));
+    const tsimd_f32x4 X = tsimd_select_f32(tsimd_eq_f32(parity, zero), C, zero);
+    const tsimd_f32x4 m = tsimd_sub_f32(L, tsimd_mul_n_f32(C, 0.5f));
+
+    const tsimd_mask lt60 = tsimd_lt_f32(H, tsimd_dup_f32(60.0f));
+    const tsimd_mask lt120 = tsimd_lt_f32(H, tsimd_dup_f32(120.0f));
+    const tsimd_mask lt180 = tsimd_lt_f32(H, tsimd_dup_f32(180.0f));
+    const tsimd_mask lt240 = tsimd_lt_f32(H, tsimd_dup_f32(240.0f));
+    const tsimd_mask lt300 = tsimd_lt_f32(H, tsimd_dup_f32(300.0f));
+    tsimd_f32x4 R = tsimd_select_f32(lt60, C, tsimd_select_f32(lt120, X,
+        tsimd_select_f32(lt240, zero, tsimd_select_f32(lt300, X, C))));
+    tsimd_f32x4 G = tsimd_select_f32(lt60, X, tsimd_select_f32(lt180, C,
+        tsimd_select_f32(lt240, X, zero)));
+    tsimd_f32x4 B = tsimd_select_f32(lt120, zero, tsimd_select_f32(lt180, X,
+        tsimd_select_f32(lt300, C, X)));
+
+    tsimd_store_f32(r+k, tsimd_add_f32(R, m));
+    tsimd_store_f32(g+k, tsimd_add_f32(G, m));
+    tsimd_store_f32(b+k, tsimd_add_f32(B, m));
+  }
+  for (; k < n; ++k) __hsl_to_rgb(h[k], s[k], l[k], r+k, g+k, b+k);
+}
+
+/**
+ * Four-wide version of __mhroth_hsl_to_rgb(). The hue is folded into +/-60deg with
+ * a single round() instead of a loop, and sin/cos are polynomial approximations.
+ */
+static void __mhroth_hsl_to_rgb_span(int n, const float *h, const float *s, const float *l, float *r, float *g, float *b) {
+  int k = 0;
+  for (; k <= n-4; k+=4) {
+    tsimd_f32x4 H = tsimd_load_f32(h+k);
+    H = tsimd_select_f32(tsimd_lt_f32(H, tsimd_dup_f32(-180.0f)), tsimd_add_f32(H, tsimd_dup_f32(360.0f)),
+        tsimd_select_f32(tsimd_gt_f32(H, tsimd_dup_f32(180.0f)), tsimd_sub_f32(H, tsimd_dup_f32(360.0f)), H));
+    H = tsimd_mul_n_f32(H, 0.017453292519943f);
+    tsimd_f32x4 S = tsimd_mul_n_f32(__clamp01(tsimd_load_f32(s+k)), 0.866025403784439f);
+    const tsimd_f32x4 L = tsimd_mul_n_f32(__clamp01(tsimd_load_f32(l+k)), 1.732050807568877f);
+
+    // ensure that saturation stays within the cube
+    const tsimd_mask lo = tsimd_lt_f32(L, tsimd_dup_f32(0.577350269189626f));
+    const tsimd_mask hi = tsimd_gt_f32(L, tsimd_dup_f32(1.154700538379252f));
+    const tsimd_f32x4 hl = tsimd_sub_f32(H, tsimd_mul_n_f32(tsimd_floor_f32(
+        tsimd_add_f32(tsimd_mul_n_f32(H, 1.0f/M_PI_2_3), tsimd_dup_f32(0.5f))), M_PI_2_3));
+    tsimd_f32x4 sinHl, cosHl;
+    tsimd_sincos_f32(hl, &sinHl, &cosHl);
+    const tsimd_f32x4 f = tsimd_select_f32(lo, L, tsimd_sub_f32(tsimd_dup_f32(1.732050807568877f), L));
+    const tsimd_f32x4 limit = tsimd_div_f32(tsimd_mul_n_f32(f, L_HEIGHT/0.577350269189626f), cosHl);
+    S = tsimd_select_f32(tsimd_or_mask(lo, hi), tsimd_min_f32(S, limit), S);
+
+    tsimd_f32x4 sinH, cosH;
+    tsimd_sincos_f32(H, &sinH, &cosH);
+    const tsimd_f32x4 x = tsimd_mul_n_f32(tsimd_mul_f32(S, cosH), 0.707106781186548f);
+    const tsimd_f32x4 y = tsimd_mul_n_f32(tsimd_mul_f32(S, sinH), 0.408248290463863f);
+    const tsimd_f32x4 z = tsimd_mul_n_f32(L, 0.577350269189626f);
+    const tsimd_f32x4 zy = tsimd_sub_f32(z, y);
+
+    tsimd_store_f32(r+k, __clamp01(tsimd_add_f32(zy, x)));
+    tsimd_store_f32(g+k, __clamp01(tsimd_add_f32(z, tsimd_mul_n_f32(y, 2.0f))));
+    tsimd_store_f32(b+k, __clamp01(tsimd_sub_f32(zy, x)));
+  }
+  for (; k < n; ++k) __mhroth_hsl_to_rgb(h[k], s[k], l[k], r+k, g+k, b+k);
+}
+
+/**
+ * Four-wide version of __mhroth_hsl_to_rgb_lut(). The cell indices and weights are
+ * computed with SIMD, the lookups are scalar, and the results are transposed back to planar.
+ */
+static void __mhroth_hsl_to_rgb_lut_span(int n, const float *h, const float *s, const float *l, float *r, float *g, float *b) {
+  const tsimd_f32x4 zero = tsimd_dup_f32(0.0f);
+  int k = 0;
+  for (; k <= n-4; k+=4) {
+    tsimd_f32x4 fh = tsimd_mul_n_f32(tsimd_add_f32(tsimd_load_f32(h+k), tsimd_dup_f32(180.0f)), LUT_NUM_H/360.0f);
+    fh = tsimd_select_f32(tsimd_lt_f32(fh, zero), tsimd_add_f32(fh, tsimd_dup_f32(LUT_NUM_H)),
+        tsimd_select_f32(tsimd_lt_f32(fh, tsimd_dup_f32(LUT_NUM_H)), fh, tsimd_sub_f32(fh, tsimd_dup_f32(LUT_NUM_H))));
+    fh = tsimd_min_f32(tsimd_max_f32(fh, zero), tsimd_dup_f32(LUT_NUM_H - 0.0001f));
+    const tsimd_f32x4 fs = tsimd_mul_n_f32(__clamp01(tsimd_load_f32(s+k)), LUT_NUM_S-1);
+    const tsimd_f32x4 L = __clamp01(tsimd_load_f32(l+k));
+    const tsimd_f32x4 seg = tsimd_select_f32(tsimd_lt_f32(L, tsimd_dup_f32(0.333333333f)), zero,
+        tsimd_select_f32(tsimd_gt_f32(L, tsimd_dup_f32(0.666666667f)), tsimd_dup_f32(2.0f), tsimd_dup_f32(1.0f)));
+    const tsimd_f32x4 fl = tsimd_min_f32(tsimd_max_f32(
+        tsimd_mul_n_f32(tsimd_sub_f32(tsimd_mul_n_f32(L, 3.0f), seg), LUT_NUM_L_SEG-1), zero),
+        tsimd_dup_f32(LUT_NUM_L_SEG-1));
+
+    const tsimd_f32x4 ih = tsimd_trunc_f32(fh);
+    const tsimd_f32x4 is = tsimd_min_f32(tsimd_trunc_f32(fs), tsimd_dup_f32(LUT_NUM_S-2));
+    const tsimd_f32x4 il = tsimd_min_f32(tsimd_trunc_f32(fl), tsimd_dup_f32(LUT_NUM_L_SEG-2));
+    // the flat table index is exactly representable as a float
+    tsimd_f32x4 index = tsimd_add_f32(tsimd_mul_n_f32(ih, LUT_NUM_S), is);
+    index = tsimd_add_f32(tsimd_mul_n_f32(index, LUT_NUM_L), tsimd_add_f32(tsimd_mul_n_f32(seg, LUT_NUM_L_SEG), il));
+    index = tsimd_mul_n_f32(index, 4.0f);
+
+    float idx[4], th[4], ts[4], tl[4];
+    tsimd_store_f32(idx, index);
+    tsimd_store_f32(th, tsimd_sub_f32(fh, ih));
+    tsimd_store_f32(ts, tsimd_sub_f32(fs, is));
+    tsimd_store_f32(tl, tsimd_sub_f32(fl, il));
+
+    tsimd_f32x4 c0 = __mhroth_lut_cell((int) idx[0], th[0], ts[0], tl[0]);
+    tsimd_f32x4 c1 = __mhroth_lut_cell((int) idx[1], th[1], ts[1], tl[1]);
+    tsimd_f32x4 c2 = __mhroth_lut_cell((int) idx[2], th[2], ts[2], tl[2]);
+    tsimd_f32x4 c3 = __mhroth_lut_cell((int) idx[3], th[3], ts[3], tl[3]);
+    tsimd_transpose_f32(&c0, &c1, &c2, &c3); // c1 = blue, c2 = green, c3 = red
+    tsimd_store_f32(b+k, c1);
+    tsimd_store_f32(g+k, c2);
+    tsimd_store_f32(r+k, c3);
+  }
+  for (; k < n; ++k) __mhroth_hsl_to_rgb_lut(h[k], s[k], l[k], r+k, g+k, b+k);
+}
+
+// HSL spans are converted to RGB in chunks on the stack, then blended.
+#define SPAN_CHUNK 64
+
+void PixelBuffer::__convert_and_blend_span(int i, int n, const float *h, const float *s, const float *l,
+    const float *a, float aConst, BlendMode mode, SpanConverter convert) {
+  assert(h != nullptr && s != nullptr && l != nullptr);
+  float r[SPAN_CHUNK], g[SPAN_CHUNK], b[SPAN_CHUNK];
+  for (int k = 0; k < n; k+=SPAN_CHUNK) {
+    const int m = (n-k < SPAN_CHUNK) ? n-k : SPAN_CHUNK;
+    convert(m, h+k, s+k, l+k, r, g, b);
+    __blend_span(i+k, m, r, g, b, (a != nullptr) ? a+k : nullptr, aConst, mode);
+  }
+}
+
+void PixelBuffer::set_span_hsl_blend(int i, int n,
+    const float *h, const float *s, const float *l, const float *a, BlendMode mode) {
+  assert(a != nullptr);
+  __convert_and_blend_span(i, n, h, s, l, a, 1.0f, mode, &__hsl_to_rgb_span);
+}
+
+void PixelBuffer::set_span_hsl_blend(int i, int n,
+    const float *h, const float *s, const float *l, float a, BlendMode mode) {
+  __convert_and_blend_span(i, n, h, s, l, nullptr, a, mode, &__hsl_to_rgb_span);
+}
+
+void PixelBuffer::set_span_mhroth_hsl_blend(int i, int n,
+    const float *h, const float *s, const float *l, const float *a, BlendMode mode) {
+  assert(a != nullptr);
+  __convert_and_blend_span(i, n, h, s, l, a, 1.0f, mode,
+      m_useMhrothLut ? &__mhroth_hsl_to_rgb_lut_span : &__mhroth_hsl_to_rgb_span);
+}
+
+void PixelBuffer::set_span_mhroth_hsl_blend(int i, int n,
+    const float *h, const float *s, const float *l, float a, BlendMode mode) {
+  __convert_and_blend_span(i, n, h, s, l, nullptr, a, mode,
+      m_useMhrothLut ? &__mhroth_hsl_to_rgb_lut_span : &__mhroth_hsl_to_rgb_span);
+}
@@ -23,6 +23,17 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <atomic>
+
+/** The number of entries in the gamma table, i.e. 12-bit input. */
+#define GAMMA_TABLE_SIZE 4096
+
+/** The order of the polynomial that approximates the gamma table when encoding. */
+#define GAMMA_POLY_ORDER 4
+
+/** The default gamma exponent for APA102 LEDs. */
+#define DEFAULT_GAMMA 2.8f
+
 class PixelBuffer {
  public:
 
@@ -37,12 +48,32 @@ class PixelBuffer {
     SCREEN, // multiplies the background and the content then complements the result
   };
 
-  PixelBuffer(uint32_t numLeds);
+  /**
+   * How pixel data is stored. All formats share the same float API.
+   *
+   * FLOAT    four floats per LED (16 bytes). Values may leave [0,1] until they are encoded.
+   * FIXED16  four unsigned Q1.15 integers per LED (8 bytes). Values saturate to [0,2), and
+   *          blending and encoding use integer arithmetic. Halves memory traffic on long strips.
+   * PLANAR   separate float arrays for red, green and blue (12 bytes per LED). Spans blend without
+   *          shuffling, and the APA102 interleave happens only when encoding.
+   */
+  enum Format : uint32_t {
+    FLOAT,
+    FIXED16,
+    PLANAR,
+  };
+
+  PixelBuffer(uint32_t numLeds, Format format=FLOAT);
   ~PixelBuffer();
 
   /** Returns the number of LEDs in the strip. */
   int getNumLeds() const { return m_numLeds; }
 
+  Format getFormat() const { return m_format; }
+
+  /** Parses "float", "fixed16" or "planar". Returns false if the name is unknown. */
+  static bool parseFormat(const char *name, Format *format);
+
   /**
    * Returns the current ampere currently being consumed by the LED strip.
    * Takes into account global brightness setting.
@@ -53,7 +84,7 @@ class PixelBuffer {
   float getCurrentWatts() const { return 5.0f * getCurrentAmperes(); }
 
   /** Returns the maximum number of amperes that could be consumed by the LED strip. */
-  float getMaxAmperes() const { return 0.06f * getNumLeds(); }
+  float getMaxAmperes() const { return (m_channelAmps[0] + m_channelAmps[1] + m_channelAmps[2]) * getNumLeds(); }
 
   /** Returns the maximum number of watts that could be consumed by the LED strip. */
   float getMaxWatts() const { return 5.0f*getMaxAmperes(); }
@@ -69,13 +100,83 @@ class PixelBuffer {
 
   float getPowerLimit();
 
-  void setNightshift(float nightshift) { m_nightshift = nightshift; }
+  /**
+   * How quickly the power limit follows the load, as the fraction of the way to the target
+   * brightness covered each frame. [0,1]. attack applies when dimming, release when brightening
+   * again. Defaults to 1 (a frame over the limit is corrected by the next one) and 0.05.
+   */
+  void setPowerLimitResponse(float attack, float release);
+
+  /**
+   * Sets the current drawn by one LED channel at full colour and brightness, in amperes.
+   * Defaults to 0.02 A for each of red, green and blue.
+   */
+  void setChannelCurrent(float red, float green, float blue);
+
+  /** The fraction of the requested brightness currently let through by the power limit. [0,1] */
+  float getPowerScale() const { return m_powerScale; }
+
+  /** Set the nightshift. [0,1]. 1 is maximum nightshift. */
+  void setNightshift(float nightshift);
 
   float getNightshift() const { return m_nightshift; }
 
+  /**
+   * Use a precomputed lookup table for the mhroth HSL colour model instead of
+   * evaluating it directly. Trades ~580KB (shared by all instances) and up to 4% error
+   * for no trigonometry per pixel. Off by default.
+   */
+  void setMhrothLut(bool enabled) { m_useMhrothLut = enabled; }
+
+  bool isMhrothLutEnabled() const { return m_useMhrothLut; }
+
+  /**
+   * Rebuilds the gamma table as x**gamma, with 12-bit input and 8-bit output.
+   * Defaults to DEFAULT_GAMMA.
+   *
+   * The encoder evaluates a polynomial fitted to the table, which rounds to within one
+   * step of it and needs no lookups. Tables that it cannot follow (e.g. gamma < ~1.8)
+   * are looked up directly, which is about 2.5x slower.
+   */
+  void setGamma(float gamma);
+
+  /** Returns the gamma exponent, or 0 if a custom table has been loaded. */
+  float getGamma() const { return m_gammaExponent; }
+
+  /** Loads a custom gamma table of GAMMA_TABLE_SIZE entries, mapping [0,1] to [0,255]. */
+  void setGammaTable(const uint8_t *table);
+
+  /**
+   * Encode with a brightness per LED instead of the global brightness. Each LED gets the
+   * smallest 5-bit brightness that can show its brightest channel, and colour bytes scaled to
+   * match, from a 16-bit gamma table. This gives about 13 bits of depth, so dim colours no longer
+   * band. The global brightness still scales everything. Off by default.
+   */
+  void setHdr(bool enabled) {
+    if (enabled != m_hdr) invalidate();
+    m_hdr = enabled;
+  }
+
+  bool isHdrEnabled() const { return m_hdr; }
+
+  /**
+   * Dither the encoded colour bytes over time. The rounding error of each byte is carried over
+   * to the next frame, so slow fades no longer step and the average output matches the float
+   * value. Best at high frame rates, where the flicker averages out. Off by default.
+   */
+  void setDither(bool enabled);
+
+  bool isDitherEnabled() const { return m_dither; }
+
   /** The number of valid bytes in the SPI buffer. */
   uint32_t getNumSpiBytes() const { return m_numSpiBytes; }
 
+  /**
+   * The number of 0xFF trailer bytes that an APA-102 strip of the given length needs
+   * after its LED data (one clock edge per two LEDs, rounded up to whole bytes).
+   */
+  static uint32_t getNumSpiTrailerBytes(uint32_t numLeds) { return (numLeds >> 4) + 1; }
+
   /** The total number of bytes backing the SPI buffer. */
   uint32_t getNumSpiBytesTotal() const { return m_numSpiBytesTotal; }
 
@@ -83,10 +184,17 @@ class PixelBuffer {
    * Converts RGB data into a buffer suitable for sending over SPI to the LED strip.
    * Takes into account global, nightshift, and power limit settings.
    *
+   * Only blocks of 4 LEDs that have been written since the last call are encoded again,
+   * unless the encoding itself has changed (e.g. global, nightshift, or the power limit
+   * scale), or dithering is enabled.
+   *
    * @return A pointer to the SPI buffer.
    */
   uint8_t *prepareAndGetSpiBytes();
 
+  /** Makes the next prepareAndGetSpiBytes() encode every LED. */
+  void invalidate() { m_isEncodeStale = true; }
+
   /**
    * Set a pixel with a given RGBA value and blend mode.
    *
@@ -124,6 +232,35 @@ class PixelBuffer {
    */
   void set_pixel_mhroth_hsl_blend(int i, float h, float s, float l, float a=1.0f, BlendMode mode=BlendMode::SET);
 
+  /**
+   * Set a span of consecutive pixels with the given RGBA values and blend mode.
+   * Equivalent to calling @set_pixel_rgb_blend for each pixel, but much faster.
+   * All arrays are planar, with n elements each.
+   *
+   * Spans that cover disjoint blocks of 4 pixels (i.e. i is a multiple of 4, and so is n
+   * unless the span ends the strip) may be set from different threads at once, see WorkerPool.
+   *
+   * @param i  Index of the first pixel.
+   * @param n  Number of pixels.
+   * @param r  Red channel values. [0,1]
+   * @param g  Green channel values. [0,1]
+   * @param b  Blue channel values. [0,1]
+   * @param a  Alpha values. [0,1]
+   * @param mode  Blend mode to combine the new and existing colors. Default to BlendMode::SET.
+   */
+  void set_span_rgb_blend(int i, int n, const float *r, const float *g, const float *b, const float *a, BlendMode mode=BlendMode::SET);
+
+  /** As above, with the same alpha value for every pixel. Defaults to 1. */
+  void set_span_rgb_blend(int i, int n, const float *r, const float *g, const float *b, float a=1.0f, BlendMode mode=BlendMode::SET);
+
+  /** Set a span of pixels with the given HSLA values. See @set_span_rgb_blend and @set_pixel_hsl_blend. */
+  void set_span_hsl_blend(int i, int n, const float *h, const float *s, const float *l, const float *a, BlendMode mode=BlendMode::SET);
+  void set_span_hsl_blend(int i, int n, const float *h, const float *s, const float *l, float a=1.0f, BlendMode mode=BlendMode::SET);
+
+  /** Set a span of pixels with the given HSLA values. See @set_span_rgb_blend and @set_pixel_mhroth_hsl_blend. */
+  void set_span_mhroth_hsl_blend(int i, int n, const float *h, const float *s, const float *l, const float *a, BlendMode mode=BlendMode::SET);
+  void set_span_mhroth_hsl_blend(int i, int n, const float *h, const float *s, const float *l, float a=1.0f, BlendMode mode=BlendMode::SET);
+
   /** Clear the buffer, set all values to 0. */
   void clear();
 
@@ -136,15 +273,45 @@ class PixelBuffer {
   bool isPowerSuppressionEngaged() const { return m_isPowerSuppressionEngaged; }
 
  private:
+  /**
+   * Blends planar RGB(A) data into the span [i,i+n). If a is null, aConst is used for all pixels.
+   * Pixels are processed four at a time. Any remainder goes through @set_pixel_rgb_blend.
+   */
+  void __blend_span(int i, int n, const float *r, const float *g, const float *b, const float *a, float aConst, BlendMode mode);
+
+  /** Converts n planar HSL values to planar RGB. */
+  typedef void (*SpanConverter)(int n, const float *h, const float *s, const float *l, float *r, float *g, float *b);
+
+  /** Converts planar HSL(A) data to RGB with the given converter, and blends it into the span [i,i+n). */
+  void __convert_and_blend_span(int i, int n, const float *h, const float *s, const float *l,
+      const float *a, float aConst, BlendMode mode, SpanConverter convert);
+
+  /** Fits m_gammaPoly to m_gamma, and decides whether it may be used. */
+  void __fit_gamma_poly();
+
+  /** Builds the (shared) mhroth HSL lookup table, if it does not exist yet. */
+  static void __build_mhroth_lut();
+
   /** The global brightness factor. [0,1] */
   float m_global;
 
   /** The total number of LEDs in this animation. */
   int m_numLeds;
 
-  /** The RGB pixel buffer. It has a format (per LED) of GLOBAL, BLUE, GREEN, RED. */
+  Format m_format;
+
+  /**
+   * The RGB pixel buffer. For FLOAT it has a format (per LED) of GLOBAL, BLUE, GREEN, RED.
+   * For PLANAR it holds the RED, GREEN and BLUE planes, m_planeStride floats apart.
+   */
   float *m_rgb;
 
+  /** The number of floats per plane, for PLANAR. */
+  int m_planeStride;
+
+  /** As m_rgb, in Q1.15 fixed point. Only for FIXED16. */
+  uint16_t *m_rgb16;
+
   /** The total length of the m_rgb buffer. */
   int m_numRgbBytesTotal;
 
@@ -165,9 +332,69 @@ class PixelBuffer {
   /** Nightshift. [0,1]. 1 is maximum nightshift. */
   float m_nightshift;
 
+  /** The RED, GREEN and BLUE gains of the nightshift white point. */
+  float m_nightshiftRgb[3];
+
   float m_currentAmps;
 
   bool m_isPowerSuppressionEngaged;
+
+  /** The brightness scale of the power limit, applied to the next frame. [0,1] */
+  float m_powerScale;
+
+  float m_powerAttack;
+  float m_powerRelease;
+
+  /** The current of the RED, GREEN and BLUE channels at full colour and brightness. */
+  float m_channelAmps[3];
+
+  /** Convert mhroth HSL colours with the lookup table. */
+  bool m_useMhrothLut;
+
+  /** Encode with a brightness per LED. */
+  bool m_hdr;
+
+  /** Dither the colour bytes. */
+  bool m_dither;
+
+  /** The error carried over to the next frame of each byte of LED data, for dithering. */
+  float *m_ditherError;
+
+  /** One flag per block of 4 LEDs, non-zero if it has been written since the last encode. */
+  uint8_t *m_dirtyBlocks;
+
+  /** The current of each block of 4 LEDs as encoded, if m_hasBlockAmps. */
+  float *m_blockAmps;
+
+  /** Whether m_blockAmps is up to date. It is only needed (and built) when encoding dirty blocks. */
+  bool m_hasBlockAmps;
+
+  /**
+   * Whether any of m_dirtyBlocks is set. Atomic (and accessed relaxed), as spans may be
+   * written from several threads at once.
+   */
+  std::atomic<bool> m_isDirty;
+
+  /** Whether the next encode must include every LED. */
+  bool m_isEncodeStale;
+
+  /** m_powerScale as of the last encode. */
+  float m_encodedPowerScale;
+
+  /** The gamma exponent of m_gamma, or 0 for a custom table. */
+  float m_gammaExponent;
+
+  /** Maps 12-bit colour values (after clamping and nightshift) to 8-bit LED values. */
+  uint8_t m_gamma[GAMMA_TABLE_SIZE];
+
+  /** As m_gamma, with 16-bit output. Used in HDR mode. */
+  uint16_t m_gamma16[GAMMA_TABLE_SIZE];
+
+  /** A polynomial on [0,1] (lowest order first) fitted to m_gamma. */
+  float m_gammaPoly[GAMMA_POLY_ORDER+1];
+
+  /** Whether m_gammaPoly is close enough to m_gamma to be used instead. */
+  bool m_hasGammaPoly;
 };
 
 #endif // _PIXEL_BUFER_HPP_
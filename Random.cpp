@@ -0,0 +1,137 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cassert>
+
+#include "Random.hpp"
+#include "tiny_simd.h"
+
+// the state of the four streams, held in registers for the length of a bulk call
+struct RandomState {
+  tsimd_u32x4 s0, s1, s2, s3;
+
+  RandomState(const uint32_t (*s)[4]) :
+      s0(tsimd_load_u32(s[0])), s1(tsimd_load_u32(s[1])),
+      s2(tsimd_load_u32(s[2])), s3(tsimd_load_u32(s[3])) {}
+
+  void store(uint32_t (*s)[4]) const {
+    tsimd_store_u32(s[0], s0); tsimd_store_u32(s[1], s1);
+    tsimd_store_u32(s[2], s2); tsimd_store_u32(s[3], s3);
+  }
+
+  // xoshiro128+, one step of each stream
+  tsimd_u32x4 next() {
+    const tsimd_u32x4 result = tsimd_add_u32(s0, s3);
+    const tsimd_u32x4 t = tsimd_shl_u32(s1, 9);
+    s2 = tsimd_xor_u32(s2, s0);
+    s3 = tsimd_xor_u32(s3, s1);
+    s1 = tsimd_xor_u32(s1, s2);
+    s0 = tsimd_xor_u32(s0, s3);
+    s2 = tsimd_xor_u32(s2, t);
+    s3 = tsimd_rotl_u32(s3, 11);
+    return result;
+  }
+
+  // uniform on [0,1), from the upper 24 bits which are the strongest
+  tsimd_f32x4 nextUniform() {
+    return tsimd_mul_n_f32(tsimd_cvt_u32_f32(tsimd_shr_u32(next(), 8)), 1.0f/16777216.0f);
+  }
+
+  // uniform on (0,1], whose log is finite
+  tsimd_f32x4 nextUniformOpen() {
+    return tsimd_sub_f32(tsimd_dup_f32(1.0f), nextUniform());
+  }
+};
+
+void Random::seed(uint64_t seed) {
+  // expand the seed to 512 bits of state with splitmix64, as recommended for xoshiro
+  for (int k = 0; k < 8; ++k) {
+    uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z = z ^ (z >> 31);
+    m_s[k/2][2*(k%2)] = (uint32_t) z;
+    m_s[k/2][2*(k%2)+1] = (uint32_t) (z >> 32);
+  }
+  m_next = 4;
+}
+
+void Random::__refill() {
+  RandomState s(m_s);
+  tsimd_store_u32(m_buffer, s.next());
+  s.store(m_s);
+  m_next = 0;
+}
+
+void Random::uniform(float *x, int n, float lo, float hi) {
+  assert(n >= 0);
+  RandomState s(m_s);
+  const tsimd_f32x4 LO = tsimd_dup_f32(lo);
+  const tsimd_f32x4 RANGE = tsimd_dup_f32(hi - lo);
+  const int N4 = n & ~3;
+  for (int i = 0; i < N4; i+=4) {
+    tsimd_store_f32(x+i, tsimd_madd_f32(LO, RANGE, s.nextUniform()));
+  }
+  if (N4 < n) {
+    float t[4];
+    tsimd_store_f32(t, tsimd_madd_f32(LO, RANGE, s.nextUniform()));
+    for (int i = N4; i < n; ++i) x[i] = t[i-N4];
+  }
+  s.store(m_s);
+}
+
+void Random::normal(float *x, int n, float mu, float sigma) {
+  assert(n >= 0);
+  RandomState s(m_s);
+  const tsimd_f32x4 MU = tsimd_dup_f32(mu);
+  const tsimd_f32x4 SIGMA = tsimd_dup_f32(sigma);
+  for (int i = 0; i < n; i+=8) {
+    // r = sqrt(-2 ln(u0)) and theta = 2 pi u1 give two independent samples, r cos(theta) and r sin(theta)
+    const tsimd_f32x4 r = tsimd_mul_f32(SIGMA,
+        tsimd_sqrt_f32(tsimd_mul_n_f32(tsimd_log_f32(s.nextUniformOpen()), -2.0f)));
+    tsimd_f32x4 sin_theta, cos_theta;
+    tsimd_sincos_f32(tsimd_mul_n_f32(s.nextUniform(), 6.283185307179586f), &sin_theta, &cos_theta);
+    const tsimd_f32x4 a = tsimd_madd_f32(MU, r, cos_theta);
+    const tsimd_f32x4 b = tsimd_madd_f32(MU, r, sin_theta);
+    if (i+8 <= n) {
+      tsimd_store_f32(x+i, a);
+      tsimd_store_f32(x+i+4, b);
+    } else {
+      float t[8];
+      tsimd_store_f32(t, a);
+      tsimd_store_f32(t+4, b);
+      for (int j = i; j < n; ++j) x[j] = t[j-i];
+    }
+  }
+  s.store(m_s);
+}
+
+void Random::exponential(float *x, int n, float lambda) {
+  assert(n >= 0);
+  assert(lambda > 0.0f);
+  RandomState s(m_s);
+  const float scale = -1.0f/lambda;
+  const int N4 = n & ~3;
+  for (int i = 0; i < N4; i+=4) {
+    tsimd_store_f32(x+i, tsimd_mul_n_f32(tsimd_log_f32(s.nextUniformOpen()), scale));
+  }
+  if (N4 < n) {
+    float t[4];
+    tsimd_store_f32(t, tsimd_mul_n_f32(tsimd_log_f32(s.nextUniformOpen()), scale));
+    for (int i = N4; i < n; ++i) x[i] = t[i-N4];
+  }
+  s.store(m_s);
+}
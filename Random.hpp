@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _RANDOM_HPP_
+#define _RANDOM_HPP_
+
+#include <stdint.h>
+
+/**
+ * A fast random number generator, four interleaved xoshiro128+ streams that are
+ * stepped together with tiny_simd. http://prng.di.unimi.it/
+ *
+ * It is a UniformRandomBitGenerator, so that it works with the std distributions.
+ * Whole arrays of uniform, normal or exponential samples are much cheaper to draw with
+ * uniform(), normal() and exponential() though, four at a time. The same seed always
+ * produces the same numbers.
+ */
+class Random {
+ public:
+  typedef uint32_t result_type;
+
+  Random(uint64_t seed = 0) { this->seed(seed); }
+
+  /** Restarts the streams from the given seed. */
+  void seed(uint64_t seed);
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT32_MAX; }
+
+  /** Returns 32 random bits. The lower bits are the weakest, prefer the bulk methods for floats. */
+  result_type operator()() {
+    if (m_next == 4) __refill();
+    return m_buffer[m_next++];
+  }
+
+  /** Fills x[0,n) with samples from the uniform distribution on [lo,hi). Rounding may return hi itself. */
+  void uniform(float *x, int n, float lo = 0.0f, float hi = 1.0f);
+
+  /**
+   * Fills x[0,n) with samples from the normal distribution, with the Box-Muller transform.
+   * The samples are within about 5.8 sigma of mu.
+   */
+  void normal(float *x, int n, float mu = 0.0f, float sigma = 1.0f);
+
+  /** Fills x[0,n) with samples from the exponential distribution of rate lambda (a mean of 1/lambda). */
+  void exponential(float *x, int n, float lambda = 1.0f);
+
+ private:
+  void __refill();
+
+  uint32_t m_s[4][4]; // the state of the four streams, one word of all four per row
+  uint32_t m_buffer[4]; // the last step, handed out by operator()
+  int m_next; // the next unused word in m_buffer
+};
+
+#endif // _RANDOM_HPP_
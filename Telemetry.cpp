@@ -0,0 +1,231 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <algorithm>
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Telemetry.hpp"
+#include "tinyosc.h"
+
+#define REPORT_INTERVAL_US 500000
+
+static const char *STAGE_NAMES[NUM_STAGES] = {"render", "encode", "output", "sleep", "frame"};
+
+Telemetry::Telemetry() : m_head(0), m_tail(0), m_numDropped(0) {
+  m_numWindow = 0;
+  m_windowIndex = 0;
+  memset(&m_stats, 0, sizeof(m_stats));
+  pthread_mutex_init(&m_statsMutex, NULL);
+  m_thread = 0;
+  m_isRunning = false;
+  m_socket = -1;
+  m_socketPath[0] = '\0';
+}
+
+Telemetry::~Telemetry() {
+  stop();
+  pthread_mutex_destroy(&m_statsMutex);
+}
+
+bool Telemetry::start(const char *socketPath) {
+  assert(!m_isRunning);
+  if (socketPath != nullptr) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path)-1);
+    strncpy(m_socketPath, socketPath, sizeof(m_socketPath)-1);
+    m_socketPath[sizeof(m_socketPath)-1] = '\0';
+    unlink(m_socketPath); // left over from a previous run
+    m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_socket < 0 || bind(m_socket, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(m_socket, 4) != 0) {
+      printf("Could not open stats socket %s: %s\n", m_socketPath, strerror(errno));
+      if (m_socket >= 0) close(m_socket);
+      m_socket = -1;
+      return false;
+    }
+  }
+
+  m_isRunning = true;
+  if (pthread_create(&m_thread, NULL, &__run, this) != 0) {
+    m_isRunning = false;
+    return false;
+  }
+  return true;
+}
+
+void Telemetry::stop() {
+  if (m_isRunning) {
+    m_isRunning = false;
+    pthread_join(m_thread, NULL);
+  }
+  if (m_socket >= 0) {
+    close(m_socket);
+    unlink(m_socketPath);
+    m_socket = -1;
+  }
+}
+
+void Telemetry::push(const FrameRecord &record) {
+  const uint32_t head = m_head.load(std::memory_order_relaxed);
+  if (head - m_tail.load(std::memory_order_acquire) == TELEMETRY_RING_SIZE) {
+    m_numDropped.fetch_add(1, std::memory_order_relaxed); // full, the reporter has fallen behind
+    return;
+  }
+  m_ring[head & (TELEMETRY_RING_SIZE-1)] = record;
+  m_head.store(head+1, std::memory_order_release);
+}
+
+void Telemetry::getStats(TelemetryStats *stats) {
+  pthread_mutex_lock(&m_statsMutex);
+  *stats = m_stats;
+  pthread_mutex_unlock(&m_statsMutex);
+}
+
+void Telemetry::__update() {
+  // drain the ring into the window
+  uint32_t tail = m_tail.load(std::memory_order_relaxed);
+  const uint32_t head = m_head.load(std::memory_order_acquire);
+  for (; tail != head; ++tail) {
+    m_window[m_windowIndex] = m_ring[tail & (TELEMETRY_RING_SIZE-1)];
+    m_windowIndex = (m_windowIndex+1) % TELEMETRY_WINDOW;
+    if (m_numWindow < TELEMETRY_WINDOW) ++m_numWindow;
+  }
+  m_tail.store(tail, std::memory_order_release);
+
+  TelemetryStats s;
+  memset(&s, 0, sizeof(s));
+  s.numFrames = m_numWindow;
+  s.numDropped = m_numDropped.load(std::memory_order_relaxed);
+  const uint32_t n = m_numWindow;
+  if (n > 0) {
+    float x[NUM_STAGES][TELEMETRY_WINDOW];
+    double totalDt = 0.0;
+    for (uint32_t i = 0; i < n; ++i) {
+      const FrameRecord &r = m_window[i];
+      x[STAGE_RENDER][i] = r.renderNs / 1000000.0f;
+      x[STAGE_ENCODE][i] = r.encodeNs / 1000000.0f;
+      x[STAGE_OUTPUT][i] = r.outputNs / 1000000.0f;
+      x[STAGE_SLEEP][i] = r.sleepNs / 1000000.0f;
+      x[STAGE_FRAME][i] = r.dt * 1000.0f;
+      totalDt += r.dt;
+      s.watts += r.watts / n;
+      s.powerSuppressed += r.isPowerSuppressed ? 1.0f/n : 0.0f;
+
+      // log2 buckets of 0.125ms
+      const uint32_t units = (r.renderNs + r.encodeNs) / 125000;
+      int bucket = 0;
+      while (bucket < TELEMETRY_NUM_BUCKETS-1 && (units >> bucket) > 0) ++bucket;
+      ++s.histogram[bucket];
+    }
+    s.fps = (totalDt > 0.0) ? (float) (n / totalDt) : 0.0f;
+
+    for (int k = 0; k < NUM_STAGES; ++k) {
+      float *y = x[k];
+      double sum = 0.0;
+      for (uint32_t i = 0; i < n; ++i) sum += y[i];
+      std::sort(y, y+n);
+      s.stages[k].mean = (float) (sum / n);
+      s.stages[k].p50 = y[n/2];
+      s.stages[k].p99 = y[std::min(n-1, (n*99)/100)];
+      s.stages[k].max = y[n-1];
+    }
+  }
+
+  pthread_mutex_lock(&m_statsMutex);
+  m_stats = s;
+  pthread_mutex_unlock(&m_statsMutex);
+}
+
+int Telemetry::writeOscStats(char *buffer, int len) {
+  TelemetryStats s;
+  getStats(&s);
+
+  tosc_bundle bundle;
+  tosc_writeBundle(&bundle, 1, buffer, len); // timetag 1 is "immediately"
+  char address[32];
+  for (int k = 0; k < NUM_STAGES; ++k) {
+    snprintf(address, sizeof(address), "/stats/%s", STAGE_NAMES[k]);
+    tosc_writeNextMessage(&bundle, address, "ffff",
+        s.stages[k].mean, s.stages[k].p50, s.stages[k].p99, s.stages[k].max);
+  }
+  tosc_writeNextMessage(&bundle, "/stats/fps", "f", s.fps);
+  tosc_writeNextMessage(&bundle, "/stats/power", "ff", s.watts, s.powerSuppressed);
+  tosc_writeNextMessage(&bundle, "/stats/histogram", "iiiiiiiiiiii",
+      s.histogram[0], s.histogram[1], s.histogram[2], s.histogram[3],
+      s.histogram[4], s.histogram[5], s.histogram[6], s.histogram[7],
+      s.histogram[8], s.histogram[9], s.histogram[10], s.histogram[11]);
+  return (int) tosc_getBundleLength(&bundle);
+}
+
+int Telemetry::writeTextStats(char *buffer, int len) {
+  TelemetryStats s;
+  getStats(&s);
+
+  int n = snprintf(buffer, len, "frames: %u (%u dropped)\nfps: %.1f\nwatts: %.2f (suppressed %.0f%%)\n"
+      "%-8s %8s %8s %8s %8s\n",
+      s.numFrames, s.numDropped, s.fps, s.watts, 100.0f*s.powerSuppressed, "ms", "mean", "p50", "p99", "max");
+  for (int k = 0; k < NUM_STAGES && n < len; ++k) {
+    n += snprintf(buffer+n, len-n, "%-8s %8.3f %8.3f %8.3f %8.3f\n", STAGE_NAMES[k],
+        s.stages[k].mean, s.stages[k].p50, s.stages[k].p99, s.stages[k].max);
+  }
+  if (n < len) n += snprintf(buffer+n, len-n, "render+encode histogram (ms):\n");
+  for (int i = 0; i < TELEMETRY_NUM_BUCKETS && n < len; ++i) {
+    const float hi = 0.125f * (1 << i);
+    if (i < TELEMETRY_NUM_BUCKETS-1) n += snprintf(buffer+n, len-n, "  < %7.3f %u\n", hi, s.histogram[i]);
+    else n += snprintf(buffer+n, len-n, "  >=%7.3f %u\n", hi/2, s.histogram[i]);
+  }
+  return std::min(n, len-1);
+}
+
+void *Telemetry::__run(void *q) {
+  Telemetry *t = (Telemetry *) q;
+  struct timeval tv = {0, REPORT_INTERVAL_US};
+  while (t->m_isRunning) {
+    if (t->m_socket < 0) {
+      usleep(REPORT_INTERVAL_US);
+      t->__update();
+      continue;
+    }
+
+    // serve the socket while waiting for the next update
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(t->m_socket, &rfds);
+    if (select(t->m_socket+1, &rfds, NULL, NULL, &tv) > 0) {
+      int fd = accept(t->m_socket, NULL, NULL);
+      if (fd >= 0) {
+        char text[2048];
+        const int n = t->writeTextStats(text, sizeof(text));
+        if (::write(fd, text, n) < 0) {} // the client may already be gone
+        close(fd);
+      }
+    } else {
+      // select() has counted tv down to zero (on Linux)
+      tv.tv_sec = 0;
+      tv.tv_usec = REPORT_INTERVAL_US;
+      t->__update();
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _TELEMETRY_HPP_
+#define _TELEMETRY_HPP_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#define TELEMETRY_RING_SIZE 1024 // must be a power of two
+#define TELEMETRY_WINDOW 512 // the number of most recent frames that statistics cover
+#define TELEMETRY_NUM_BUCKETS 12 // histogram buckets, see TelemetryStats
+
+/** What happened in one frame. */
+typedef struct {
+  uint32_t renderNs; // Animation::process()
+  uint32_t encodeNs; // PixelBuffer::prepareAndGetSpiBytes()
+  uint32_t outputNs; // the most recent OutputDriver::write(), on the output thread
+  uint32_t sleepNs;  // waiting for the next frame deadline
+  float dt;          // the time step of the next frame, in seconds
+  float watts;
+  bool isPowerSuppressed;
+} FrameRecord;
+
+enum TelemetryStage {
+  STAGE_RENDER,
+  STAGE_ENCODE,
+  STAGE_OUTPUT,
+  STAGE_SLEEP,
+  STAGE_FRAME, // dt
+  NUM_STAGES,
+};
+
+/** Statistics over the most recent frames. All times in milliseconds. */
+typedef struct {
+  struct {
+    float mean;
+    float p50;
+    float p99;
+    float max;
+  } stages[NUM_STAGES];
+  float fps;
+  float watts; // mean
+  float powerSuppressed; // the fraction of frames with power suppression engaged
+  uint32_t numFrames; // the number of frames in the window
+  uint32_t numDropped; // records lost because the ring was full
+
+  // render + encode time, bucket i counts frames in [2^(i-1), 2^i) * 0.125ms.
+  // The first bucket is everything below 0.125ms, the last everything from 128ms.
+  uint32_t histogram[TELEMETRY_NUM_BUCKETS];
+} TelemetryStats;
+
+/**
+ * Collects per-frame records from the render loop through a lock-free single-producer
+ * single-consumer ring, and periodically summarises them on a reporter thread.
+ *
+ * The summary can be read with getStats(), as an OSC bundle (see writeOscStats()), and
+ * optionally as text from a Unix domain socket, e.g. `socat - UNIX-CONNECT:<path>`.
+ */
+class Telemetry {
+ public:
+  Telemetry();
+  ~Telemetry();
+
+  /**
+   * Starts the reporter thread.
+   *
+   * @param socketPath  If not null, serve the statistics as text on a Unix socket at this path.
+   */
+  bool start(const char *socketPath=nullptr);
+
+  void stop();
+
+  /** Records one frame. Called only by the render loop. Never blocks. */
+  void push(const FrameRecord &record);
+
+  /** Copies the latest statistics. Thread-safe. */
+  void getStats(TelemetryStats *stats);
+
+  /**
+   * Writes the latest statistics as an OSC bundle of /stats/<stage> (mean, p50, p99, max),
+   * /stats/fps, /stats/power (watts, suppressed fraction) and /stats/histogram messages.
+   *
+   * @return  The length of the bundle in bytes.
+   */
+  int writeOscStats(char *buffer, int len);
+
+  /** Writes the latest statistics as human-readable text. Returns the length in bytes. */
+  int writeTextStats(char *buffer, int len);
+
+ private:
+  static void *__run(void *q);
+
+  /** Moves all records from the ring into the window and recomputes the statistics. */
+  void __update();
+
+  FrameRecord m_ring[TELEMETRY_RING_SIZE];
+  std::atomic<uint32_t> m_head; // written by the producer
+  std::atomic<uint32_t> m_tail; // written by the consumer
+  std::atomic<uint32_t> m_numDropped;
+
+  // reporter thread only
+  FrameRecord m_window[TELEMETRY_WINDOW];
+  uint32_t m_numWindow;
+  uint32_t m_windowIndex;
+
+  pthread_mutex_t m_statsMutex;
+  TelemetryStats m_stats;
+
+  pthread_t m_thread;
+  volatile bool m_isRunning;
+  int m_socket;
+  char m_socketPath[108];
+};
+
+#endif // _TELEMETRY_HPP_
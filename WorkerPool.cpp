@@ -0,0 +1,129 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "WorkerPool.hpp"
+
+WorkerPool::WorkerPool(int numThreads) {
+  if (numThreads <= 0) numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (numThreads <= 0) numThreads = 1;
+
+  m_fn = nullptr;
+  m_f = nullptr;
+  m_n = 0;
+  m_tileSize = 0;
+  m_numTiles = 0;
+  m_nextTile = 0;
+  m_generation = 0;
+  m_numBusy = 0;
+  m_isRunning = true;
+  pthread_mutex_init(&m_mutex, NULL);
+  pthread_cond_init(&m_wake, NULL);
+  pthread_cond_init(&m_done, NULL);
+
+  // the workers inherit the scheduling policy and CPU affinity of the caller
+  m_threads = (pthread_t *) malloc((numThreads-1) * sizeof(pthread_t));
+  m_numWorkers = 0;
+  for (int i = 0; i < numThreads-1; ++i) {
+    if (pthread_create(m_threads+i, NULL, &__run_worker, this) != 0) {
+      printf("Could not start worker thread %i.\n", i);
+      break;
+    }
+    ++m_numWorkers;
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  pthread_mutex_lock(&m_mutex);
+  m_isRunning = false;
+  pthread_cond_broadcast(&m_wake);
+  pthread_mutex_unlock(&m_mutex);
+  for (int i = 0; i < m_numWorkers; ++i) pthread_join(m_threads[i], NULL);
+  free(m_threads);
+
+  pthread_cond_destroy(&m_done);
+  pthread_cond_destroy(&m_wake);
+  pthread_mutex_destroy(&m_mutex);
+}
+
+void WorkerPool::__run(int n, int tileSize, TileFunction fn, const void *f) {
+  assert(n >= 0);
+  assert(tileSize > 0 && (tileSize & 0x3) == 0);
+
+  const int numTiles = getNumTiles(n, tileSize);
+  if (numTiles <= 1 || m_numWorkers == 0) {
+    // not worth waking anyone
+    for (int k = 0; k < numTiles; ++k) {
+      fn(f, k, k*tileSize, (k+1 < numTiles) ? (k+1)*tileSize : n);
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&m_mutex);
+  m_fn = fn;
+  m_f = f;
+  m_n = n;
+  m_tileSize = tileSize;
+  m_numTiles = numTiles;
+  m_nextTile.store(0, std::memory_order_relaxed);
+  m_numBusy = m_numWorkers;
+  ++m_generation;
+  pthread_cond_broadcast(&m_wake);
+  pthread_mutex_unlock(&m_mutex);
+
+  __work();
+
+  // the job (and f) must outlive every worker that is still on it
+  pthread_mutex_lock(&m_mutex);
+  while (m_numBusy > 0) pthread_cond_wait(&m_done, &m_mutex);
+  pthread_mutex_unlock(&m_mutex);
+}
+
+void WorkerPool::__work() {
+  int k;
+  while ((k = m_nextTile.fetch_add(1, std::memory_order_relaxed)) < m_numTiles) {
+    const int begin = k * m_tileSize;
+    const int end = (k+1 < m_numTiles) ? begin + m_tileSize : m_n;
+    m_fn(m_f, k, begin, end);
+  }
+}
+
+void *WorkerPool::__run_worker(void *q) {
+  WorkerPool *p = (WorkerPool *) q;
+
+  // a worker starts before the first job, whose generation is 1
+  uint32_t generation = 0;
+
+  pthread_mutex_lock(&p->m_mutex);
+  while (true) {
+    while (p->m_isRunning && p->m_generation == generation) pthread_cond_wait(&p->m_wake, &p->m_mutex);
+    if (!p->m_isRunning) break;
+    generation = p->m_generation;
+    pthread_mutex_unlock(&p->m_mutex);
+
+    p->__work();
+
+    pthread_mutex_lock(&p->m_mutex);
+    if (--p->m_numBusy == 0) pthread_cond_signal(&p->m_done);
+  }
+  pthread_mutex_unlock(&p->m_mutex);
+
+  return NULL;
+}
@@ -0,0 +1,97 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _WORKER_POOL_HPP_
+#define _WORKER_POOL_HPP_
+
+#include <pthread.h>
+
+#include <atomic>
+
+/**
+ * A fixed set of threads that render independent ranges of LEDs in parallel.
+ *
+ * parallelFor() splits [0,n) into tiles of tileSize LEDs. Tiles are a multiple of the
+ * encoder's 4-LED blocks, so that no two tiles ever touch the same block (see
+ * PixelBuffer::set_span_rgb_blend()). Tiles are numbered in order and depend only on
+ * n and tileSize, never on the number of threads. Anything that a tile derives from
+ * its number (e.g. a random number stream) is therefore the same however the tiles
+ * happen to be scheduled.
+ *
+ * The calling thread works alongside the pool, and parallelFor() returns once every
+ * tile is done. It must only be called from one thread at a time.
+ */
+class WorkerPool {
+ public:
+  /**
+   * @param numThreads  The total number of threads, including the caller.
+   *                    A non-positive number means one per online CPU.
+   */
+  WorkerPool(int numThreads=0);
+  ~WorkerPool();
+
+  /** Returns the total number of threads, including the caller. */
+  int getNumThreads() const { return m_numWorkers + 1; }
+
+  /** Returns the number of tiles that [0,n) is split into. */
+  static int getNumTiles(int n, int tileSize) { return (n + tileSize - 1) / tileSize; }
+
+  /**
+   * Calls f(tile, begin, end) for each tile of [0,n), where [begin,end) is the range of
+   * the tile. A single tile runs directly on the calling thread.
+   *
+   * @param tileSize  A positive multiple of 4.
+   */
+  template <typename F>
+  void parallelFor(int n, int tileSize, const F &f) {
+    __run(n, tileSize, &__call<F>, &f);
+  }
+
+ private:
+  typedef void (*TileFunction)(const void *f, int tile, int begin, int end);
+
+  template <typename F>
+  static void __call(const void *f, int tile, int begin, int end) {
+    (*((const F *) f))(tile, begin, end);
+  }
+
+  void __run(int n, int tileSize, TileFunction fn, const void *f);
+
+  // takes tiles of the current job until there are none left
+  void __work();
+
+  static void *__run_worker(void *q);
+
+  int m_numWorkers;
+  pthread_t *m_threads;
+
+  // the current job, written by __run() before the workers are woken
+  TileFunction m_fn;
+  const void *m_f;
+  int m_n;
+  int m_tileSize;
+  int m_numTiles;
+  std::atomic<int> m_nextTile;
+
+  pthread_mutex_t m_mutex;
+  pthread_cond_t m_wake; // a new job, or stopping
+  pthread_cond_t m_done; // the last worker has finished the job
+  uint32_t m_generation; // incremented for each job, guarded by m_mutex
+  int m_numBusy; // workers still on the current job, guarded by m_mutex
+  bool m_isRunning;
+};
+
+#endif // _WORKER_POOL_HPP_
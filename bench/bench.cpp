@@ -0,0 +1,399 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "PixelBuffer.hpp"
+#include "WorkerPool.hpp"
+
+#include "AnimPhasor.hpp"
+#include "AnimLorenzOsc.hpp"
+#include "AnimLorenzOscFade.hpp"
+#include "AnimChuaOsc.hpp"
+#include "AnimAllWhite.hpp"
+#include "AnimLighthouse.hpp"
+#include "AnimEiffelTower.hpp"
+#include "AnimLorenzPhasor.hpp"
+#include "AnimReactionDiffusion.hpp"
+
+#include "test_anims/AnimRain.hpp"
+#include "test_anims/AnimRandomFlow.hpp"
+#include "test_anims/AnimXmasPhasor.hpp"
+
+#define SEC_TO_NS 1000000000LL
+#define NUM_WARMUP_FRAMES 10
+#define MIN_FRAMES 10
+
+template <typename T> static Animation *create(PixelBuffer *pixbuf) { return new T(pixbuf); }
+
+typedef struct {
+  const char *name;
+  Animation *(*create)(PixelBuffer *);
+} AnimEntry;
+
+static const AnimEntry ANIMATIONS[] = {
+  {"Phasor",            &create<AnimPhasor>},
+  {"LorenzOsc",         &create<AnimLorenzOsc>},
+  {"LorenzOscFade",     &create<AnimLorenzOscFade>},
+  {"ChuaOsc",           &create<AnimChuaOsc>},
+  {"Lighthouse",        &create<AnimLighthouse>},
+  {"EiffelTower",       &create<AnimEiffelTower>},
+  {"AllWhite",          &create<AnimAllWhite>},
+  {"LorenzPhasor",      &create<AnimLorenzPhasor>},
+  {"ReactionDiffusion", &create<AnimReactionDiffusion>}, // grid is N x 64
+  {"Rain",              &create<AnimRain>},
+  {"RandomFlow",        &create<AnimRandomFlow>},
+  {"XmasPhasor",        &create<AnimXmasPhasor>},
+};
+
+static const int DEFAULT_LEDS[] = {300, 1000, 3000, 10000, 30000, 100000};
+
+typedef struct {
+  const char *name;
+  PixelBuffer::Format format;
+} FormatEntry;
+
+static const FormatEntry FORMATS[] = {
+  {"float",   PixelBuffer::FLOAT},
+  {"fixed16", PixelBuffer::FIXED16},
+  {"planar",  PixelBuffer::PLANAR},
+};
+
+// PixelBuffer operations timed by --kernels
+enum Kernel {
+  FILL_RGB,
+  APPLY_GAIN,
+  SPAN_SET,
+  SPAN_ADD,
+  SPAN_ACCUMULATE,
+  SPAN_DIFFERENCE,
+  SPAN_MULTIPLY,
+  SPAN_SCREEN,
+  ENCODE,
+  ENCODE_SPARSE,
+  NUM_KERNELS
+};
+
+static const char *KERNEL_NAMES[NUM_KERNELS] = {
+  "fill_rgb", "apply_gain", "span_set", "span_add", "span_accumulate",
+  "span_difference", "span_multiply", "span_screen", "encode", "encode_sparse"
+};
+
+static uint64_t now_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((uint64_t) t.tv_sec) * SEC_TO_NS + (uint64_t) t.tv_nsec;
+}
+
+/** Adds n bytes to a 64-bit FNV-1a hash. */
+static uint64_t __fnv1a(uint64_t hash, const uint8_t *data, uint32_t n) {
+  for (uint32_t i = 0; i < n; ++i) {
+    hash = (hash ^ data[i]) * 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+static void printStats(const char *name, int numLeds, const char *stage, std::vector<uint64_t> &ns) {
+  uint64_t sum = 0;
+  for (uint64_t x : ns) sum += x;
+  std::sort(ns.begin(), ns.end());
+  const size_t n = ns.size();
+  const double mean = ((double) sum) / n;
+  printf("%-18s %7i  %-7s %12.0f %9.2f %12llu %12llu %12llu\n",
+      name, numLeds, stage, mean, mean/numLeds,
+      (unsigned long long) ns[n/2],
+      (unsigned long long) ns[std::min(n-1, (n*99)/100)],
+      (unsigned long long) ns[n-1]);
+}
+
+static void runKernel(Kernel kernel, PixelBuffer *pixbuf,
+    const float *r, const float *g, const float *b, const float *a) {
+  const int n = pixbuf->getNumLeds();
+  switch (kernel) {
+    case FILL_RGB: pixbuf->fill_rgb(0.5f, 0.25f, 0.125f); break;
+    case APPLY_GAIN: pixbuf->apply_gain(0.99f); break;
+    case SPAN_SET: pixbuf->set_span_rgb_blend(0, n, r, g, b, a, PixelBuffer::SET); break;
+    case SPAN_ADD: pixbuf->set_span_rgb_blend(0, n, r, g, b, a, PixelBuffer::ADD); break;
+    case SPAN_ACCUMULATE: pixbuf->set_span_rgb_blend(0, n, r, g, b, a, PixelBuffer::ACCUMULATE); break;
+    case SPAN_DIFFERENCE: pixbuf->set_span_rgb_blend(0, n, r, g, b, a, PixelBuffer::DIFFERENCE); break;
+    case SPAN_MULTIPLY: pixbuf->set_span_rgb_blend(0, n, r, g, b, a, PixelBuffer::MULTIPLY); break;
+    case SPAN_SCREEN: pixbuf->set_span_rgb_blend(0, n, r, g, b, a, PixelBuffer::SCREEN); break;
+    case ENCODE:
+    case ENCODE_SPARSE: {
+      volatile uint8_t *spi = pixbuf->prepareAndGetSpiBytes();
+      (void) spi;
+      break;
+    }
+    default: break;
+  }
+}
+
+/**
+ * Times the individual PixelBuffer operations in each pixel format, instead of whole
+ * animations. The "stage" column is the format.
+ */
+static void runKernels(const char *filter, const std::vector<int> &leds, bool hasFormat,
+    PixelBuffer::Format format, float gamma, bool hdr, bool dither, int maxFrames, uint64_t maxNs) {
+  printf("%-18s %7s  %-7s %12s %9s %12s %12s %12s\n",
+      "kernel", "leds", "format", "ns/call", "ns/led", "p50", "p99", "max");
+
+  std::vector<uint64_t> ns;
+  ns.reserve(maxFrames);
+  for (int k = 0; k < NUM_KERNELS; ++k) {
+    if (filter != nullptr && strstr(KERNEL_NAMES[k], filter) == nullptr) continue;
+
+    for (int numLeds : leds) {
+      // random planar source data
+      std::vector<float> src(4*numLeds);
+      for (float &x : src) x = ((float) rand()) / RAND_MAX;
+      const float *r = src.data(), *g = r + numLeds, *b = g + numLeds, *a = b + numLeds;
+
+      for (const FormatEntry &f : FORMATS) {
+        if (hasFormat && f.format != format) continue;
+
+        PixelBuffer *pixbuf = new PixelBuffer(numLeds, f.format);
+        pixbuf->setGamma(gamma);
+        pixbuf->setHdr(hdr);
+        pixbuf->setDither(dither);
+        pixbuf->set_span_rgb_blend(0, numLeds, r, g, b, 1.0f);
+        for (int i = 0; i < NUM_WARMUP_FRAMES; ++i) {
+          runKernel((Kernel) k, pixbuf, r, g, b, a);
+        }
+
+        ns.clear();
+        const uint64_t start = now_ns();
+        for (int i = 0; i < maxFrames; ++i) {
+          if (k >= SPAN_SET && k <= SPAN_SCREEN) {
+            // reset the destination, otherwise e.g. MULTIPLY decays into denormals
+            pixbuf->set_span_rgb_blend(0, numLeds, r, g, b, 1.0f);
+          } else if (k == ENCODE) {
+            pixbuf->invalidate();
+          } else if (k == ENCODE_SPARSE) {
+            // one LED in 64 has changed
+            for (int j = (i & 63); j < numLeds; j+=64) pixbuf->set_pixel_rgb_blend(j, r[j], g[j], b[j]);
+          }
+          const uint64_t t0 = now_ns();
+          runKernel((Kernel) k, pixbuf, r, g, b, a);
+          const uint64_t t1 = now_ns();
+          ns.push_back(t1 - t0);
+          if (i+1 >= MIN_FRAMES && (t1 - start) >= maxNs) break;
+        }
+        printStats(KERNEL_NAMES[k], numLeds, f.name, ns);
+        fflush(stdout);
+
+        delete pixbuf;
+      }
+    }
+  }
+}
+
+static void printUsage(const char *name) {
+  printf("Usage: %s [options]\n", name);
+  printf("  -a, --anim <name>     Only run animations (or kernels) whose name contains <name>.\n");
+  printf("  -n, --leds <n,...>    Comma-separated LED counts. Default 300,1000,3000,10000,30000,100000.\n");
+  printf("  -f, --frames <n>      Maximum number of frames per run. Default 2000.\n");
+  printf("  -t, --time <seconds>  Maximum time per run. Default 1.\n");
+  printf("  -r, --fps <fps>       The fixed frame rate used to derive dt. Default 60.\n");
+  printf("  -l, --mhroth-lut      Convert mhroth HSL colours with the lookup table.\n");
+  printf("  -F, --format <name>   Pixel buffer format: float (default), fixed16 or planar.\n");
+  printf("  -g, --gamma <gamma>   Gamma exponent. Default 2.8.\n");
+  printf("  -H, --hdr             Encode with a brightness per LED.\n");
+  printf("  -d, --dither          Dither the encoded colours over time.\n");
+  printf("  -j, --threads <n>     Render with n threads, 0 for one per CPU. Default 1.\n");
+  printf("  -S, --seed <n>        Seed the animations' random numbers with n. Default 1, 0 seeds from the clock.\n");
+  printf("  -k, --kernels         Time the PixelBuffer kernels in every format (or only -F) instead of animations.\n");
+  printf("  -x, --hash            Print a hash of the SPI output of exactly -f frames instead of timing them.\n");
+}
+
+/**
+ * Runs every animation at a range of strip lengths with a fixed dt, and reports the
+ * time spent in Animation::process() ("render") and PixelBuffer::prepareAndGetSpiBytes()
+ * ("encode") separately. All times are in nanoseconds.
+ */
+int main(int narg, char **argc) {
+  const char *filter = nullptr;
+  std::vector<int> leds;
+  int maxFrames = 2000;
+  double maxSeconds = 1.0;
+  double fps = 60.0;
+  bool useMhrothLut = false;
+  PixelBuffer::Format format = PixelBuffer::FLOAT;
+  bool hasFormat = false;
+  bool runsKernels = false;
+  bool hashes = false;
+  float gamma = DEFAULT_GAMMA;
+  bool hdr = false;
+  bool dither = false;
+  int numThreads = 1;
+  uint64_t seed = 1; // every run renders the same frames
+
+  static const struct option LONG_OPTIONS[] = {
+    {"anim", required_argument, NULL, 'a'},
+    {"leds", required_argument, NULL, 'n'},
+    {"frames", required_argument, NULL, 'f'},
+    {"time", required_argument, NULL, 't'},
+    {"fps", required_argument, NULL, 'r'},
+    {"mhroth-lut", no_argument, NULL, 'l'},
+    {"format", required_argument, NULL, 'F'},
+    {"gamma", required_argument, NULL, 'g'},
+    {"hdr", no_argument, NULL, 'H'},
+    {"dither", no_argument, NULL, 'd'},
+    {"threads", required_argument, NULL, 'j'},
+    {"seed", required_argument, NULL, 'S'},
+    {"kernels", no_argument, NULL, 'k'},
+    {"hash", no_argument, NULL, 'x'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  int opt;
+  while ((opt = getopt_long(narg, argc, "a:n:f:t:r:lF:g:Hdj:S:kxh", LONG_OPTIONS, NULL)) != -1) {
+    switch (opt) {
+      case 'a': filter = optarg; break;
+      case 'n': {
+        for (char *s = strtok(optarg, ","); s != nullptr; s = strtok(nullptr, ",")) {
+          if (atoi(s) > 0) leds.push_back(atoi(s));
+        }
+        break;
+      }
+      case 'f': maxFrames = std::max(MIN_FRAMES, atoi(optarg)); break;
+      case 't': maxSeconds = atof(optarg); break;
+      case 'r': fps = atof(optarg); break;
+      case 'l': useMhrothLut = true; break;
+      case 'F': {
+        if (!PixelBuffer::parseFormat(optarg, &format)) {
+          printf("Unknown pixel format: %s\n", optarg);
+          printUsage(argc[0]);
+          return -1;
+        }
+        hasFormat = true;
+        break;
+      }
+      case 'g': gamma = atof(optarg); break;
+      case 'H': hdr = true; break;
+      case 'd': dither = true; break;
+      case 'j': numThreads = atoi(optarg); break;
+      case 'S': seed = strtoull(optarg, NULL, 0); break;
+      case 'k': runsKernels = true; break;
+      case 'x': hashes = true; break;
+      default: printUsage(argc[0]); return -1;
+    }
+  }
+  if (leds.empty()) {
+    leds.assign(DEFAULT_LEDS, DEFAULT_LEDS + sizeof(DEFAULT_LEDS)/sizeof(int));
+  }
+  if (gamma <= 0.0f) {
+    printf("The gamma exponent must be positive.\n");
+    return -1;
+  }
+  if (fps <= 0.0) {
+    printf("The frame rate must be positive.\n");
+    return -1;
+  }
+  const double dt = 1.0/fps;
+  Animation::setRandomSeed(seed);
+  const uint64_t maxNs = (uint64_t) (maxSeconds * SEC_TO_NS);
+
+  if (runsKernels) {
+    printf("# calls: <= %i, time: <= %g s per run\n", maxFrames, maxSeconds);
+    runKernels(filter, leds, hasFormat, format, gamma, hdr, dither, maxFrames, maxNs);
+    return 0;
+  }
+
+  WorkerPool *pool = (numThreads != 1) ? new WorkerPool(numThreads) : nullptr;
+  if (hashes) {
+    // The output must not depend on the SIMD backend, see tiny_simd.h and `make parity`.
+    printf("# dt: %g s, frames: %i, format: %i, gamma: %g, hdr: %i, dither: %i, mhroth-lut: %i\n",
+        dt, maxFrames, format, gamma, hdr, dither, useMhrothLut);
+    printf("%-18s %7s  %16s\n", "animation", "leds", "fnv1a");
+  } else {
+    printf("# dt: %g s, frames: <= %i, time: <= %g s per run, threads: %i\n", dt, maxFrames, maxSeconds,
+        (pool != nullptr) ? pool->getNumThreads() : 1);
+    printf("%-18s %7s  %-7s %12s %9s %12s %12s %12s\n",
+        "animation", "leds", "stage", "ns/frame", "ns/led", "p50", "p99", "max");
+  }
+
+  std::vector<uint64_t> renderNs;
+  std::vector<uint64_t> encodeNs;
+  renderNs.reserve(maxFrames);
+  encodeNs.reserve(maxFrames);
+
+  for (const AnimEntry &entry : ANIMATIONS) {
+    if (filter != nullptr && strstr(entry.name, filter) == nullptr) continue;
+
+    for (int numLeds : leds) {
+      PixelBuffer *pixbuf = new PixelBuffer(numLeds, format);
+      pixbuf->setMhrothLut(useMhrothLut);
+      pixbuf->setGamma(gamma);
+      pixbuf->setHdr(hdr);
+      pixbuf->setDither(dither);
+      Animation *anim = entry.create(pixbuf);
+      anim->setWorkerPool(pool);
+
+      if (hashes) {
+        uint64_t hash = 0xCBF29CE484222325ULL;
+        for (int i = 0; i < maxFrames; ++i) {
+          anim->process(dt);
+          hash = __fnv1a(hash, pixbuf->prepareAndGetSpiBytes(), pixbuf->getNumSpiBytes());
+        }
+        printf("%-18s %7i  %016llx\n", entry.name, numLeds, (unsigned long long) hash);
+        fflush(stdout);
+
+        delete anim;
+        delete pixbuf;
+        continue;
+      }
+
+      for (int i = 0; i < NUM_WARMUP_FRAMES; ++i) {
+        anim->process(dt);
+        pixbuf->prepareAndGetSpiBytes();
+      }
+
+      renderNs.clear();
+      encodeNs.clear();
+      const uint64_t start = now_ns();
+      for (int i = 0; i < maxFrames; ++i) {
+        const uint64_t t0 = now_ns();
+        anim->process(dt);
+        const uint64_t t1 = now_ns();
+        volatile uint8_t *spi = pixbuf->prepareAndGetSpiBytes();
+        const uint64_t t2 = now_ns();
+        (void) spi;
+
+        renderNs.push_back(t1 - t0);
+        encodeNs.push_back(t2 - t1);
+        if (i+1 >= MIN_FRAMES && (t2 - start) >= maxNs) break;
+      }
+
+      printStats(entry.name, numLeds, "render", renderNs);
+      printStats(entry.name, numLeds, "encode", encodeNs);
+      fflush(stdout);
+
+      delete anim;
+      delete pixbuf;
+    }
+  }
+
+  delete pool;
+  return 0;
+}
@@ -17,6 +17,7 @@
 #include <assert.h>
 #include <arpa/inet.h>
 #include <fcntl.h> // for open
+#include <getopt.h>
 #include <ifaddrs.h>
 #include <pthread.h>
 #include <signal.h>
@@ -30,9 +31,13 @@
 
 #include "tinypipe.h"
 #include "tinyosc.h"
-#include "tiny_spi.h"
 
+#include "OutputDriver.hpp"
+#include "OutputThread.hpp"
+#include "FrameScheduler.hpp"
+#include "Telemetry.hpp"
 #include "PixelBuffer.hpp"
+#include "WorkerPool.hpp"
 
 #include "AnimPhasor.hpp"
 #include "AnimLorenzOsc.hpp"
@@ -42,9 +47,9 @@
 #include "AnimLighthouse.hpp"
 #include "AnimEiffelTower.hpp"
 #include "AnimLorenzPhasor.hpp"
+#include "AnimReactionDiffusion.hpp"
 
 #define SEC_TO_NS 1000000000LL
-#define SPI_HZ 9000000
 #define GPIO_INPUT_PIN 2
 
 
@@ -67,11 +72,20 @@ static volatile unsigned int *gpio;
 
 static volatile bool _keepRunning = true;
 
+// per-frame statistics, also read by the network thread to answer /stats
+static Telemetry *_telemetry = nullptr;
+
 static void sigintHandler(int x) {
   printf("Termination signal received.\n"); // handle Ctrl+C
   _keepRunning = false;
 }
 
+static uint64_t now_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (((uint64_t) t.tv_sec) * SEC_TO_NS) + (uint64_t) t.tv_nsec;
+}
+
 static void timespec_subtract(struct timespec *result, struct timespec *end, struct timespec *start) {
   if (end->tv_nsec < start->tv_nsec) {
     result->tv_sec = end->tv_sec - start->tv_sec - 1;
@@ -83,11 +97,12 @@ static void timespec_subtract(struct timespec *result, struct timespec *end, str
 }
 
 // Set up a memory regions to access GPIO
-void gpio_open() {
+// Returns false if GPIO is not available on this machine.
+bool gpio_open() {
   // open /dev/mem (requires sudo)
   // open /dev/gpiomem (does not require sudo)
   int fd = open("/dev/gpiomem", O_RDWR|O_SYNC);
-  assert(fd > 0 && "Can't open /dev/gpiomem");
+  if (fd < 0) return false;
 
   // mmap GPIO
   void *gpio_map = mmap(
@@ -102,17 +117,32 @@ void gpio_open() {
   close(fd); // No need to keep fd open after mmap
 
   if (gpio_map == MAP_FAILED) {
-    printf("mmap error %d\n", (int) gpio_map); // errno also set!
+    printf("mmap error %p\n", gpio_map); // errno also set!
     exit(-1);
   }
 
   // always use volatile pointer
   gpio = (volatile unsigned *) gpio_map;
+  return true;
 }
 
 // declare the network run function
 static void *network_run(void *q);
 
+static void printUsage(const char *name) {
+  printf("Usage: %s [options] <leds> [fps] [global] [watts]\n", name);
+  printf("  -o, --output <spec>  Output driver: spi[:<dev>], null, file:<path>, shm[:<name>],\n");
+  printf("                       artnet:<host>[:<port>], multi:<spec>=<leds>,...\n");
+  printf("                       Defaults to spi:/dev/spidev0.0.\n");
+  printf("  -p, --policy <name>  What to do when a frame is late: drop, stretch (default) or lower.\n");
+  printf("  -R, --realtime <n>   Run with SCHED_FIFO priority n.\n");
+  printf("  -c, --cpu <n>        Pin the render loop to CPU n.\n");
+  printf("  -s, --stats <path>   Serve frame statistics as text on a Unix socket.\n");
+  printf("  -F, --format <name>  Pixel buffer format: float (default), fixed16 or planar.\n");
+  printf("  -j, --threads <n>    Render with n threads. Defaults to one per CPU, 1 renders on the main thread only.\n");
+  printf("  -S, --seed <n>       Seed the animations' random numbers with n, to reproduce a run. Defaults to the clock.\n");
+}
+
 /**
  * The main function has a number of commandline arguments, including:
  *
@@ -123,54 +153,164 @@ static void *network_run(void *q);
  *
  * e.g. 300 LEDs, maximum framerate, full brightness, limited to 50 watts
  * ./playatower 300 -1 1 50
+ *
+ * Options:
+ *
+ * -o, --output: the output driver spec, see OutputDriver.hpp
+ * -p, --policy: the frame overrun policy, see FrameScheduler.hpp
+ * -R, --realtime: SCHED_FIFO priority
+ * -c, --cpu: the CPU to pin the render loop to
+ * -s, --stats: a Unix socket path for frame statistics, see Telemetry.hpp
+ * -F, --format: the pixel buffer format, see PixelBuffer.hpp
+ * -j, --threads: the number of render threads, see WorkerPool.hpp
+ * -S, --seed: a fixed random seed for the animations, see Animation.hpp
+ *
+ * e.g. run headless, measuring render throughput only
+ * ./playatower --output null 300 -1 1 50
  */
 int main(int narg, char **argc) {
 
-  TinySpi tspi;
-  struct timespec tick_start, tick, tock, diff_tick;
+  struct timespec tick_start, tock, diff_tick;
   uint32_t global_step = 0; // the current frame index
   float total_energy = 0.0f; // the total energy (joules) used since the beginning
-  uint64_t total_elapsed_ns = 0;
   uint64_t next_print_ns = 0;
 
   // register signal handlers
   signal(SIGINT, &sigintHandler); // SIGINT (Crtl+C)
   signal(SIGTERM, &sigintHandler); // SIGTERM (kill pid)
+  signal(SIGPIPE, SIG_IGN); // a closed output pipe is reported by write()
   printf("Press Ctrl+C to quit.\n");
 
-  const int NUM_LEDS = (narg > 1) ? atoi(argc[1]) : 0;
+  // parse options, the remaining arguments are positional
+  // NOTE: options must precede the positional arguments, as e.g. an fps of -1 is not an option
+  const char *outputSpec = "spi:/dev/spidev0.0";
+  FrameScheduler::OverrunPolicy policy = FrameScheduler::STRETCH;
+  int realtimePriority = 0; // not realtime
+  int cpu = -1; // not pinned
+  const char *statsSocket = nullptr;
+  PixelBuffer::Format format = PixelBuffer::FLOAT;
+  int numThreads = 0; // one per CPU
+  static const struct option LONG_OPTIONS[] = {
+    {"output", required_argument, NULL, 'o'},
+    {"policy", required_argument, NULL, 'p'},
+    {"realtime", required_argument, NULL, 'R'},
+    {"cpu", required_argument, NULL, 'c'},
+    {"stats", required_argument, NULL, 's'},
+    {"format", required_argument, NULL, 'F'},
+    {"threads", required_argument, NULL, 'j'},
+    {"seed", required_argument, NULL, 'S'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  int opt;
+  while ((opt = getopt_long(narg, argc, "+o:p:R:c:s:F:j:S:h", LONG_OPTIONS, NULL)) != -1) {
+    switch (opt) {
+      case 'o': outputSpec = optarg; break;
+      case 'p': {
+        if (!FrameScheduler::parsePolicy(optarg, &policy)) {
+          printf("Unknown overrun policy: %s\n", optarg);
+          printUsage(argc[0]);
+          return -1;
+        }
+        break;
+      }
+      case 'R': realtimePriority = atoi(optarg); break;
+      case 'c': cpu = atoi(optarg); break;
+      case 's': statsSocket = optarg; break;
+      case 'F': {
+        if (!PixelBuffer::parseFormat(optarg, &format)) {
+          printf("Unknown pixel format: %s\n", optarg);
+          printUsage(argc[0]);
+          return -1;
+        }
+        break;
+      }
+      case 'j': numThreads = atoi(optarg); break;
+      case 'S': Animation::setRandomSeed(strtoull(optarg, NULL, 0)); break;
+      default: printUsage(argc[0]); return -1;
+    }
+  }
+  const int nargs = narg - optind;
+  char **args = argc + optind;
+
+  const int NUM_LEDS = (nargs > 0) ? atoi(args[0]) : 0;
   if (NUM_LEDS <= 0) {
     printf("Must have at least one argument indicating the number of LEDs.\n");
+    printUsage(argc[0]);
     return -1;
   }
   printf("* leds: %i\n", NUM_LEDS);
 
-  const double FPS = (narg > 2) ? atof(argc[2]) : -1.0; // frames per second
-  const double SPF = 1.0/FPS; // second per frame
-  const uint64_t NS_FRAME = (FPS > 0.0) ? (uint64_t) (1000000000.0/FPS) : 0;
+  const double FPS = (nargs > 1) ? atof(args[1]) : -1.0; // frames per second
   printf("* fps: %g\n", FPS);
 
-  const float GLOBAL_BRIGHTNESS = (narg > 3) ? fmaxf(0.0f,fminf(1.0f,atof(argc[3]))) : 1.0f;
+  const float GLOBAL_BRIGHTNESS = (nargs > 2) ? fmaxf(0.0f,fminf(1.0f,atof(args[2]))) : 1.0f;
   printf("* global: %0.3g (%i/31)\n", GLOBAL_BRIGHTNESS, static_cast<int>(GLOBAL_BRIGHTNESS*31.0f));
 
-  const float MAX_WATTS = (narg > 4) ? atof(argc[4]) : -1.0f;
+  const float MAX_WATTS = (nargs > 3) ? atof(args[3]) : -1.0f;
   printf("* max. watts: %0.3f\n", MAX_WATTS);
 
-  // open the SPI interface
-  tspi_open(&tspi, "/dev/spidev0.0", SPI_HZ);
+  // open the output driver
+  OutputDriver *output = OutputDriver::create(outputSpec);
+  if (output == nullptr) {
+    printf("Unknown output driver: %s\n", outputSpec);
+    printUsage(argc[0]);
+    return -1;
+  }
+  if (!output->open()) {
+    delete output;
+    return -1;
+  }
+  printf("* output: %s\n", outputSpec);
 
-  // open the GPIO interface
-  gpio_open();
-  INP_GPIO(GPIO_INPUT_PIN); // configure GPIO pin as input
+  // open the GPIO interface (the button is optional, e.g. when running headless)
+  const bool hasGpio = gpio_open();
+  if (hasGpio) {
+    INP_GPIO(GPIO_INPUT_PIN); // configure GPIO pin as input
+  } else {
+    printf("* gpio: not available, button disabled\n");
+  }
 
-  PixelBuffer *pixbuf = new PixelBuffer(NUM_LEDS);
+  PixelBuffer *pixbuf = new PixelBuffer(NUM_LEDS, format);
   pixbuf->setGlobal(GLOBAL_BRIGHTNESS);
   pixbuf->setPowerLimit(MAX_WATTS);
 
   printf("* SPI buffer: %i [%i] bytes\n", pixbuf->getNumSpiBytes(), pixbuf->getNumSpiBytesTotal());
   printf("\n");
 
+  // the output thread inherits the scheduling policy
+  if (realtimePriority > 0 && FrameScheduler::setRealtime(realtimePriority)) {
+    printf("* realtime: SCHED_FIFO %i\n", realtimePriority);
+  }
+
+  // frames are written from a separate thread, so that the next one can be rendered meanwhile.
+  // When running as fast as possible, the output paces the animation instead of dropping frames.
+  OutputThread *writer = new OutputThread(output, pixbuf->getNumSpiBytesTotal());
+  if (!writer->start()) {
+    delete writer;
+    output->close();
+    delete output;
+    return -1;
+  }
+
+  // the render threads, created before pinning so that they are free to run on any CPU
+  WorkerPool *pool = new WorkerPool(numThreads);
+  printf("* render threads: %i\n", pool->getNumThreads());
+
   Animation *anim = new AnimPhasor(pixbuf); // initialise with default animation
+  anim->setWorkerPool(pool);
+
+  // an animation's preferred frame rate takes precedence over the commandline
+  FrameScheduler scheduler((anim->getPreferredFps() > 0.0) ? anim->getPreferredFps() : FPS, policy);
+
+  // start collecting frame statistics
+  _telemetry = new Telemetry();
+  if (!_telemetry->start(statsSocket)) {
+    delete _telemetry;
+    _telemetry = nullptr;
+  } else if (statsSocket != nullptr) {
+    printf("* stats: %s\n", statsSocket);
+  }
 
   // start the network thread (with pipe)
   TinyPipe pipe;
@@ -178,6 +318,11 @@ int main(int narg, char **argc) {
   pthread_t networkThread = 0;
   pthread_create(&networkThread, NULL, &network_run, &pipe);
 
+  // pin only the render loop, the other threads should be free to run alongside it
+  if (cpu >= 0 && FrameScheduler::pinToCpu(cpu)) {
+    printf("* cpu: %i\n", cpu);
+  }
+
   int lastButtonState = (1<<GPIO_INPUT_PIN); // GPIO pin is high when *not* connected
   uint32_t anim_index = 0;
   bool toNextAnim = false;
@@ -188,14 +333,14 @@ int main(int narg, char **argc) {
   double dt = 0.0;
   while (_keepRunning) {
 
-    clock_gettime(CLOCK_MONOTONIC, &tick);
-
     // check the state of the button
-    int currentButtonState = GET_GPIO(GPIO_INPUT_PIN);
-    if (lastButtonState != 0 && currentButtonState == 0) {
-      toNextAnim = true;
+    if (hasGpio) {
+      int currentButtonState = GET_GPIO(GPIO_INPUT_PIN);
+      if (lastButtonState != 0 && currentButtonState == 0) {
+        toNextAnim = true;
+      }
+      lastButtonState = currentButtonState;
     }
-    lastButtonState = currentButtonState;
 
     // read messages from network
     while (tpipe_hasData(&pipe)) {
@@ -213,6 +358,15 @@ int main(int narg, char **argc) {
           pixbuf->setNightshift(tosc_getNextFloat(&osc));
         } else if (!strcmp(tosc_getAddress(&osc), "/powerlimit")) {
           pixbuf->setPowerLimit(tosc_getNextFloat(&osc));
+        } else if (!strcmp(tosc_getAddress(&osc), "/gamma")) {
+          const float gamma = tosc_getNextFloat(&osc);
+          if (gamma > 0.0f) pixbuf->setGamma(gamma);
+        } else if (!strcmp(tosc_getAddress(&osc), "/hdr")) {
+          pixbuf->setHdr(tosc_getNextFloat(&osc) >= 0.5f);
+        } else if (!strcmp(tosc_getAddress(&osc), "/dither")) {
+          pixbuf->setDither(tosc_getNextFloat(&osc) >= 0.5f);
+        } else if (!strcmp(tosc_getAddress(&osc), "/mhroth_lut")) {
+          pixbuf->setMhrothLut(tosc_getNextFloat(&osc) >= 0.5f);
         } else if (!strncmp(tosc_getAddress(&osc), "/param/", 7)) {
           // e.g. /param/0 0.5
           int index = atoi(tosc_getAddress(&osc)+7); // parameter index >= 0
@@ -232,7 +386,7 @@ int main(int narg, char **argc) {
       pixbuf->clear(); // clear the pixel buffer
 
       // instantiate the next animation
-      anim_index = (anim_index+1) % 8;
+      anim_index = (anim_index+1) % 9;
       switch (anim_index) {
         default:
         case 0: anim = new AnimPhasor(pixbuf); break;
@@ -243,51 +397,58 @@ int main(int narg, char **argc) {
         case 5: anim = new AnimEiffelTower(pixbuf); break;
         case 6: anim = new AnimAllWhite(pixbuf); break;
         case 7: anim = new AnimLorenzPhasor(pixbuf); break;
+        case 8: anim = new AnimReactionDiffusion(pixbuf); break;
         // case 6: anim = new AnimRain(pixbuf); break;
         // case 7: anim = new AnimRandomFlow(pixbuf); break;
-        // case 9: anim = new AnimReactionDiffusion(pixbuf); break;
       }
+      anim->setWorkerPool(pool);
 
-      // FPS = anim->getPreferredFps();
+      scheduler.setFps((anim->getPreferredFps() > 0.0) ? anim->getPreferredFps() : FPS);
       dt = 0.0;
     }
 
     // calculate animation
+    const uint64_t render_ns = now_ns();
     anim->process(dt);
 
-    // send LED data via SPI
-    tspi_write(&tspi, pixbuf->getNumSpiBytes(), pixbuf->prepareAndGetSpiBytes());
+    // encode the LED data and hand it to the output thread (usually SPI)
+    const uint64_t encode_ns = now_ns();
+    uint8_t *spiBytes = pixbuf->prepareAndGetSpiBytes();
+    const uint64_t submit_ns = now_ns();
+    writer->submit(pixbuf->getNumSpiBytes(), spiBytes, scheduler.isUnlimited());
 
     // keep track of total energy use
     total_energy += pixbuf->getCurrentWatts() * dt;
 
-    clock_gettime(CLOCK_MONOTONIC, &tock);
-    timespec_subtract(&diff_tick, &tock, &tick);
-    const uint64_t elapsed_ns = (((uint64_t) diff_tick.tv_sec) * SEC_TO_NS) + (uint64_t) diff_tick.tv_nsec;
-    if (elapsed_ns < NS_FRAME) {
-      // NOTE(mhroth): there is never a need to sleep longer than 1 second (famous last words...)
-      diff_tick.tv_sec = 0;
-      diff_tick.tv_nsec = (long) (NS_FRAME-elapsed_ns);
-      dt = SPF;
-      nanosleep(&diff_tick, NULL);
-    } else {
-      dt = ((double) elapsed_ns) / 1000000000.0;
-      if (FPS > 0.0) printf("Warning: frame underrun.\n");
+    // wait for the deadline of the next frame
+    const uint64_t sleep_ns = now_ns();
+    dt = scheduler.waitForNextFrame();
+
+    if (_telemetry != nullptr) {
+      FrameRecord record;
+      record.renderNs = (uint32_t) (encode_ns - render_ns);
+      record.encodeNs = (uint32_t) (submit_ns - encode_ns);
+      record.outputNs = (uint32_t) writer->getLastWriteNs();
+      record.sleepNs = (uint32_t) (now_ns() - sleep_ns);
+      record.dt = (float) dt;
+      record.watts = pixbuf->getCurrentWatts();
+      record.isPowerSuppressed = pixbuf->isPowerSuppressionEngaged();
+      _telemetry->push(record);
     }
 
     // track total elapsed time
-    total_elapsed_ns += elapsed_ns;
+    clock_gettime(CLOCK_MONOTONIC, &tock);
+    timespec_subtract(&diff_tick, &tock, &tick_start);
+    const uint64_t total_elapsed_ns = (((uint64_t) diff_tick.tv_sec) * SEC_TO_NS) + (uint64_t) diff_tick.tv_nsec;
 
     // print info every half second
     if (total_elapsed_ns > next_print_ns) {
       next_print_ns += SEC_TO_NS/2;
 
-      // calculate total runtime
-      timespec_subtract(&diff_tick, &tock, &tick_start);
       float total_watt_hours = total_energy/3600.0f;
 
-      printf("\r| %6.1f fps | %7.3f Watts (%4.1f%%) [%4.1f Amps] | %8.2fWh total | %9i frames | %0.3f global [%s] | %0.3f nightshift | %.32s | [%g]",
-          1.0/dt, pixbuf->getCurrentWatts(), 100.0f*pixbuf->getCurrentWatts()/pixbuf->getMaxWatts(), pixbuf->getCurrentAmperes(),
+      printf("\r| %6.1f fps [%u late] | %5.2f ms out [%u dropped, %u failed] | %7.3f Watts (%4.1f%%) [%4.1f Amps] | %8.2fWh total | %9i frames | %0.3f global [%s] | %0.3f nightshift | %.32s | [%g]",
+          1.0/dt, scheduler.getNumOverruns(), writer->getLastWriteNs()/1000000.0, writer->getNumFramesDropped(), writer->getNumWriteErrors(), pixbuf->getCurrentWatts(), 100.0f*pixbuf->getCurrentWatts()/pixbuf->getMaxWatts(), pixbuf->getCurrentAmperes(),
           total_watt_hours, global_step, pixbuf->getGlobal(), pixbuf->isPowerSuppressionEngaged() ? "x" : " ",
           pixbuf->getNightshift(), anim->getName(), anim->getParameter(0));
       fflush(stdout);
@@ -298,13 +459,20 @@ int main(int narg, char **argc) {
 
   // turn off all LEDs
   pixbuf->clear();
-  tspi_write(&tspi, pixbuf->getNumSpiBytes(), pixbuf->prepareAndGetSpiBytes());
+  writer->submit(pixbuf->getNumSpiBytes(), pixbuf->prepareAndGetSpiBytes(), true);
+  writer->stop(); // writes the last frame before returning
+  printf("\n* written: %u frames, %llu bytes [%u dropped, %u failed]\n", output->getNumFramesWritten(),
+      (unsigned long long) output->getNumBytesWritten(), writer->getNumFramesDropped(), writer->getNumWriteErrors());
 
-  munmap((void *) gpio, BLOCK_SIZE); // unmap the gpio memory
+  if (hasGpio) munmap((void *) gpio, BLOCK_SIZE); // unmap the gpio memory
   pthread_join(networkThread, NULL); // wait for the network thread to stop
+  delete _telemetry; // stop collecting statistics (after the network thread, which uses them)
   tpipe_free(&pipe); // destroy the pipe from the network thread to the main thread
-  tspi_close(&tspi); // close the SPI interface
+  delete writer; // delete the output thread
+  output->close(); // close the output interface (e.g. SPI)
+  delete output; // delete the output driver
   delete anim; // delete the animation
+  delete pool; // stop the render threads
   delete pixbuf; // delete the pixel buffer
 
   return 0;
@@ -339,6 +507,16 @@ void *network_run(void *q) {
       int sa_len = sizeof(struct sockaddr_in);
 
       while ((len = recvfrom(fd, network_buffer, sizeof(network_buffer), 0, (struct sockaddr *) &sin, (socklen_t *) &sa_len)) > 0) {
+        // answer /stats directly, it does not concern the render loop
+        if (len >= 8 && !memcmp(network_buffer, "/stats\0\0", 8)) {
+          if (_telemetry != nullptr) {
+            char reply[1024];
+            const int n = _telemetry->writeOscStats(reply, sizeof(reply));
+            sendto(fd, reply, n, 0, (struct sockaddr *) &sin, sa_len);
+          }
+          continue;
+        }
+
         // put message on pipe
         char *pipe_buffer = tpipe_getWriteBuffer((TinyPipe *) q, len);
         assert(pipe_buffer != nullptr);
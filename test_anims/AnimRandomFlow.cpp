@@ -19,12 +19,9 @@
 AnimRandomFlow::AnimRandomFlow(PixelBuffer *pixbuf) : Animation(pixbuf) {
   __state.resize(3*pixbuf->getNumLeds());
   __kernel.resize(9);
-  __d_uniform = std::uniform_real_distribution<float>(0.0f, 1.0f);
-  __d_gauss = std::normal_distribution<float>(-0.05f, 5.0f);
+  __noise.resize(3*pixbuf->getNumLeds());
 
-  for (int i = 0; i < __state.size(); i++) {
-    __state[i] = __d_uniform(_gen);
-  }
+  _gen.uniform(__state.data(), __state.size());
 
   __kernel[0] = 0.2f;
   __kernel[1] = 0.4f;
@@ -50,10 +47,7 @@ void AnimRandomFlow::__normalise(float *b, int n) {
 
 void AnimRandomFlow::_process(double dt) {
   const int N = _pixbuf->getNumLeds();
-  for (int i = 0; i < N; ++i) {
-    float r = __d_gauss(_gen);
-    float g = __d_gauss(_gen);
-    float b = __d_gauss(_gen);
-    _pixbuf->set_pixel_rgb_blend(i, r, g, b, dt, PixelBuffer::BlendMode::ACCUMULATE);
-  }
+  _gen.normal(__noise.data(), 3*N, -0.05f, 5.0f);
+  const float *r = __noise.data();
+  _pixbuf->set_span_rgb_blend(0, N, r, r+N, r+2*N, (float) dt, PixelBuffer::BlendMode::ACCUMULATE);
 }
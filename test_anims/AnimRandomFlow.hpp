@@ -33,8 +33,7 @@ class AnimRandomFlow: public Animation {
 
   std::vector<float> __state;
   std::vector<float> __kernel;
-  std::uniform_real_distribution<float> __d_uniform;
-  std::normal_distribution<float> __d_gauss;
+  std::vector<float> __noise; // planar RGB noise of this frame
 };
 
 #endif // _ANIM_RANDOM_FLOW_HPP_
@@ -0,0 +1,908 @@
+/**
+ * Copyright (c) 2018, Martin Roth (mhroth@gmail.com)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _TINY_SIMD_H_
+#define _TINY_SIMD_H_
+
+/*
+ * A minimal 4-lane SIMD layer. The backend is chosen at compile time:
+ *
+ *   TSIMD_NEON    ARM NEON (RPi2/RPi3)
+ *   TSIMD_SSE     x86 SSE2 (also used when compiling with AVX/AVX2)
+ *   TSIMD_SCALAR  plain C, for everything else
+ *
+ * Defining TSIMD_FORCE_SCALAR selects the scalar backend on any platform.
+ * All backends produce bit-identical results for the operations below, with the
+ * exception of NaN handling in min/max and of tsimd_div_f32() and tsimd_sqrt_f32()
+ * on ARMv7. Clamp with max(x, lo) before min(x, hi) so that NaNs are flushed to lo
+ * everywhere. This only holds if the compiler may neither reassociate nor contract
+ * floating point operations, so users must be built with -fno-fast-math and
+ * -ffp-contract=off (see the Makefile, and `make parity`, which checks it).
+ *
+ * Besides floats there are four-lane unsigned 32-bit integers (for random number
+ * generators), eight-lane unsigned 16-bit integers (for fixed-point pixel data) and
+ * sixteen-lane bytes (for the SPI stream).
+ */
+
+#include <stdint.h>
+
+#if !defined(TSIMD_FORCE_SCALAR) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+  #define TSIMD_NEON 1
+  #include <arm_neon.h>
+#elif !defined(TSIMD_FORCE_SCALAR) && (defined(__SSE2__) || defined(_M_X64))
+  #define TSIMD_SSE 1
+  #include <emmintrin.h>
+  #include <xmmintrin.h>
+#else
+  #define TSIMD_SCALAR 1
+  #include <math.h>
+  #include <string.h>
+#endif
+
+// whether the target has fused multiply-adds, see tsimd_madd_f32()
+#if defined(__FMA__) || defined(__ARM_FEATURE_FMA)
+  #define TSIMD_FMA 1
+  #if TSIMD_SSE
+    #include <immintrin.h>
+  #endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if TSIMD_NEON
+typedef float32x4_t tsimd_f32x4;
+typedef uint8x16_t tsimd_u8x16;
+#elif TSIMD_SSE
+typedef __m128 tsimd_f32x4;
+typedef __m128i tsimd_u8x16;
+#else
+typedef struct { float f[4]; } tsimd_f32x4;
+typedef struct { uint8_t u[16]; } tsimd_u8x16;
+#endif
+
+#if TSIMD_NEON
+typedef uint32x4_t tsimd_u32x4;
+typedef uint16x8_t tsimd_u16x8;
+#elif TSIMD_SSE
+typedef __m128i tsimd_u32x4;
+typedef __m128i tsimd_u16x8;
+#else
+typedef struct { uint32_t u[4]; } tsimd_u32x4;
+typedef struct { uint16_t u[8]; } tsimd_u16x8;
+#endif
+
+// a lane-wise boolean, as produced by the comparisons below
+#if TSIMD_NEON
+typedef uint32x4_t tsimd_mask;
+#elif TSIMD_SSE
+typedef __m128 tsimd_mask;
+#else
+typedef struct { uint32_t u[4]; } tsimd_mask;
+#endif
+
+/** Returns the name of the compiled backend. */
+static inline const char *tsimd_backend() {
+#if TSIMD_NEON
+  return "neon";
+#elif TSIMD_SSE
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+/** Loads four floats. The pointer need not be aligned. */
+static inline tsimd_f32x4 tsimd_load_f32(const float *p) {
+#if TSIMD_NEON
+  return vld1q_f32(p);
+#elif TSIMD_SSE
+  return _mm_loadu_ps(p);
+#else
+  tsimd_f32x4 x = {{p[0], p[1], p[2], p[3]}};
+  return x;
+#endif
+}
+
+/** Stores four floats. The pointer need not be aligned. */
+static inline void tsimd_store_f32(float *p, tsimd_f32x4 x) {
+#if TSIMD_NEON
+  vst1q_f32(p, x);
+#elif TSIMD_SSE
+  _mm_storeu_ps(p, x);
+#else
+  p[0] = x.f[0]; p[1] = x.f[1]; p[2] = x.f[2]; p[3] = x.f[3];
+#endif
+}
+
+/** Returns {a, a, a, a}. */
+static inline tsimd_f32x4 tsimd_dup_f32(float a) {
+#if TSIMD_NEON
+  return vdupq_n_f32(a);
+#elif TSIMD_SSE
+  return _mm_set1_ps(a);
+#else
+  tsimd_f32x4 x = {{a, a, a, a}};
+  return x;
+#endif
+}
+
+/** Returns {a, b, c, d}, with a in lane 0. */
+static inline tsimd_f32x4 tsimd_set_f32(float a, float b, float c, float d) {
+#if TSIMD_NEON
+  return (float32x4_t) {a, b, c, d};
+#elif TSIMD_SSE
+  return _mm_setr_ps(a, b, c, d);
+#else
+  tsimd_f32x4 x = {{a, b, c, d}};
+  return x;
+#endif
+}
+
+/** Returns lane i of x. */
+static inline float tsimd_get_lane_f32(tsimd_f32x4 x, int i) {
+  float t[4];
+  tsimd_store_f32(t, x);
+  return t[i];
+}
+
+static inline tsimd_f32x4 tsimd_add_f32(tsimd_f32x4 a, tsimd_f32x4 b) {
+#if TSIMD_NEON
+  return vaddq_f32(a, b);
+#elif TSIMD_SSE
+  return _mm_add_ps(a, b);
+#else
+  tsimd_f32x4 x = {{a.f[0]+b.f[0], a.f[1]+b.f[1], a.f[2]+b.f[2], a.f[3]+b.f[3]}};
+  return x;
+#endif
+}
+
+static inline tsimd_f32x4 tsimd_sub_f32(tsimd_f32x4 a, tsimd_f32x4 b) {
+#if TSIMD_NEON
+  return vsubq_f32(a, b);
+#elif TSIMD_SSE
+  return _mm_sub_ps(a, b);
+#else
+  tsimd_f32x4 x = {{a.f[0]-b.f[0], a.f[1]-b.f[1], a.f[2]-b.f[2], a.f[3]-b.f[3]}};
+  return x;
+#endif
+}
+
+static inline tsimd_f32x4 tsimd_mul_f32(tsimd_f32x4 a, tsimd_f32x4 b) {
+#if TSIMD_NEON
+  return vmulq_f32(a, b);
+#elif TSIMD_SSE
+  return _mm_mul_ps(a, b);
+#else
+  tsimd_f32x4 x = {{a.f[0]*b.f[0], a.f[1]*b.f[1], a.f[2]*b.f[2], a.f[3]*b.f[3]}};
+  return x;
+#endif
+}
+
+/** Multiplies all lanes of a by the scalar b. */
+static inline tsimd_f32x4 tsimd_mul_n_f32(tsimd_f32x4 a, float b) {
+#if TSIMD_NEON
+  return vmulq_n_f32(a, b);
+#else
+  return tsimd_mul_f32(a, tsimd_dup_f32(b));
+#endif
+}
+
+/**
+ * Returns a + b*c. It is fused (rounded once) in every backend if the target has fused
+ * multiply-adds (TSIMD_FMA), and rounded twice in every backend otherwise, so that all
+ * backends agree (see above).
+ */
+static inline tsimd_f32x4 tsimd_madd_f32(tsimd_f32x4 a, tsimd_f32x4 b, tsimd_f32x4 c) {
+#if TSIMD_NEON && TSIMD_FMA
+  return vfmaq_f32(a, b, c);
+#elif TSIMD_NEON
+  return vmlaq_f32(a, b, c);
+#elif TSIMD_SSE && TSIMD_FMA
+  return _mm_fmadd_ps(b, c, a);
+#elif TSIMD_SCALAR && TSIMD_FMA
+  tsimd_f32x4 x;
+  for (int i = 0; i < 4; ++i) x.f[i] = fmaf(b.f[i], c.f[i], a.f[i]);
+  return x;
+#else
+  return tsimd_add_f32(a, tsimd_mul_f32(b, c));
+#endif
+}
+
+static inline tsimd_f32x4 tsimd_min_f32(tsimd_f32x4 a, tsimd_f32x4 b) {
+#if TSIMD_NEON
+  return vminq_f32(a, b);
+#elif TSIMD_SSE
+  return _mm_min_ps(a, b);
+#else
+  tsimd_f32x4 x;
+  for (int i = 0; i < 4; ++i) x.f[i] = (a.f[i] < b.f[i]) ? a.f[i] : b.f[i];
+  return x;
+#endif
+}
+
+static inline tsimd_f32x4 tsimd_max_f32(tsimd_f32x4 a, tsimd_f32x4 b) {
+#if TSIMD_NEON
+  return vmaxq_f32(a, b);
+#elif TSIMD_SSE
+  return _mm_max_ps(a, b);
+#else
+  tsimd_f32x4 x;
+  for (int i = 0; i < 4; ++i) x.f[i] = (a.f[i] > b.f[i]) ? a.f[i] : b.f[i];
+  return x;
+#endif
+}
+
+static inline tsimd_f32x4 tsimd_abs_f32(tsimd_f32x4 a) {
+#if TSIMD_NEON
+  return vabsq_f32(a);
+#elif TSIMD_SSE
+  return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+#else
+  tsimd_f32x4 x;
+  for (int i = 0; i < 4; ++i) x.f[i] = (a.f[i] < 0.0f) ? -a.f[i] : a.f[i];
+  return x;
+#endif
+}
+
+/**
+ * Transposes the 4x4 matrix whose rows are a, b, c, d, in place.
+ * e.g. converts four interleaved pixels into four planar channels, and back.
+ */
+static inline void tsimd_transpose_f32(tsimd_f32x4 *a, tsimd_f32x4 *b, tsimd_f32x4 *c, tsimd_f32x4 *d) {
+#if TSIMD_NEON
+  float32x4x2_t ab = vtrnq_f32(*a, *b); // a0 b0 a2 b2, a1 b1 a3 b3
+  float32x4x2_t cd = vtrnq_f32(*c, *d); // c0 d0 c2 d2, c1 d1 c3 d3
+  *a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+  *b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+  *c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+  *d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+#elif TSIMD_SSE
+  _MM_TRANSPOSE4_PS(*a, *b, *c, *d);
+#else
+  tsimd_f32x4 *rows[4] = {a, b, c, d};
+  for (int i = 0; i < 4; ++i) {
+    for (int j = i+1; j < 4; ++j) {
+      float t = rows[i]->f[j];
+      rows[i]->f[j] = rows[j]->f[i];
+      rows[j]->f[i] = t;
+    }
+  }
+#endif
+}
+
+/** Returns a/b. On ARMv7 this is a reciprocal estimate refined to within a few ulp. */
+static inline tsimd_f32x4 tsimd_div_f32(tsimd_f32x4 a, tsimd_f32x4 b) {
+#if TSIMD_NEON && defined(__aarch64__)
+  return vdivq_f32(a, b);
+#elif TSIMD_NEON
+  float32x4_t r = vrecpeq_f32(b);
+  r = vmulq_f32(vrecpsq_f32(b, r), r); // Newton-Raphson refinement
+  r = vmulq_f32(vrecpsq_f32(b, r), r);
+  return vmulq_f32(a, r);
+#elif TSIMD_SSE
+  return _mm_div_ps(a, b);
+#else
+  tsimd_f32x4 x = {{a.f[0]/b.f[0], a.f[1]/b.f[1], a.f[2]/b.f[2], a.f[3]/b.f[3]}};
+  return x;
+#endif
+}
+
+/** Returns sqrt(a), a >= 0. On ARMv7 this is a reciprocal estimate refined to within a few ulp. */
+static inline tsimd_f32x4 tsimd_sqrt_f32(tsimd_f32x4 a) {
+#if TSIMD_NEON && defined(__aarch64__)
+  return vsqrtq_f32(a);
+#elif TSIMD_NEON
+  float32x4_t r = vrsqrteq_f32(a);
+  r = vmulq_f32(vrsqrtsq_f32(vmulq_f32(a, r), r), r); // Newton-Raphson refinement
+  r = vmulq_f32(vrsqrtsq_f32(vmulq_f32(a, r), r), r);
+  return vbslq_f32(vceqq_f32(a, vdupq_n_f32(0.0f)), a, vmulq_f32(a, r)); // 1/sqrt(0) is inf
+#elif TSIMD_SSE
+  return _mm_sqrt_ps(a);
+#else
+  tsimd_f32x4 x = {{sqrtf(a.f[0]), sqrtf(a.f[1]), sqrtf(a.f[2]), sqrtf(a.f[3])}};
+  return x;
+#endif
+}
+
+/** Rounds towards zero. |a| must be less than 2^31. */
+static inline tsimd_f32x4 tsimd_trunc_f32(tsimd_f32x4 a) {
+#if TSIMD_NEON
+  return vcvtq_f32_s32(vcvtq_s32_f32(a));
+#elif TSIMD_SSE
+  return _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+#else
+  tsimd_f32x4 x;
+  for (int i = 0; i < 4; ++i) x.f[i] = (float) (int32_t) a.f[i];
+  return x;
+#endif
+}
+
+static inline tsimd_mask tsimd_lt_f32(tsimd_f32x4 a, tsimd_f32x4 b) {
+#if TSIMD_NEON
+  return vcltq_f32(a, b);
+#elif TSIMD_SSE
+  return _mm_cmplt_ps(a, b);
+#else
+  tsimd_mask x;
+  for (int i = 0; i < 4; ++i) x.u[i] = (a.f[i] < b.f[i]) ? 0xFFFFFFFF : 0;
+  return x;
+#endif
+}
+
+static inline tsimd_mask tsimd_gt_f32(tsimd_f32x4 a, tsimd_f32x4 b) {
+  return tsimd_lt_f32(b, a);
+}
+
+static inline tsimd_mask tsimd_eq_f32(tsimd_f32x4 a, tsimd_f32x4 b) {
+#if TSIMD_NEON
+  return vceqq_f32(a, b);
+#elif TSIMD_SSE
+  return _mm_cmpeq_ps(a, b);
+#else
+  tsimd_mask x;
+  for (int i = 0; i < 4; ++i) x.u[i] = (a.f[i] == b.f[i]) ? 0xFFFFFFFF : 0;
+  return x;
+#endif
+}
+
+static inline tsimd_mask tsimd_or_mask(tsimd_mask a, tsimd_mask b) {
+#if TSIMD_NEON
+  return vorrq_u32(a, b);
+#elif TSIMD_SSE
+  return _mm_or_ps(a, b);
+#else
+  tsimd_mask x;
+  for (int i = 0; i < 4; ++i) x.u[i] = a.u[i] | b.u[i];
+  return x;
+#endif
+}
+
+/** Returns m ? a : b, lane-wise. */
+static inline tsimd_f32x4 tsimd_select_f32(tsimd_mask m, tsimd_f32x4 a, tsimd_f32x4 b) {
+#if TSIMD_NEON
+  return vbslq_f32(m, a, b);
+#elif TSIMD_SSE
+  return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+#else
+  tsimd_f32x4 x;
+  for (int i = 0; i < 4; ++i) x.f[i] = m.u[i] ? a.f[i] : b.f[i];
+  return x;
+#endif
+}
+
+/** Rounds towards negative infinity. |a| must be less than 2^31. */
+static inline tsimd_f32x4 tsimd_floor_f32(tsimd_f32x4 a) {
+  tsimd_f32x4 t = tsimd_trunc_f32(a);
+  return tsimd_select_f32(tsimd_gt_f32(t, a), tsimd_sub_f32(t, tsimd_dup_f32(1.0f)), t);
+}
+
+/**
+ * Computes sin(x) and cos(x) with a polynomial approximation (after Cephes sinf/cosf).
+ * The absolute error is below 1e-6 for |x| < 8192.
+ */
+static inline void tsimd_sincos_f32(tsimd_f32x4 x, tsimd_f32x4 *s, tsimd_f32x4 *c) {
+  // reduce to r in [-pi/4,pi/4] and quadrant q, x = q*(pi/2) + r
+  tsimd_f32x4 q = tsimd_floor_f32(tsimd_add_f32(tsimd_mul_n_f32(x, 0.636619772367581f), tsimd_dup_f32(0.5f)));
+  tsimd_f32x4 r = tsimd_sub_f32(x, tsimd_mul_n_f32(q, 1.5703125f)); // extended precision modular arithmetic
+  r = tsimd_sub_f32(r, tsimd_mul_n_f32(q, 4.837512969970703125e-4f));
+  r = tsimd_sub_f32(r, tsimd_mul_n_f32(q, 7.54978995489188216e-8f));
+  const tsimd_f32x4 r2 = tsimd_mul_f32(r, r);
+
+  // sin(r) = r + r^3*(S1 + r^2*(S2 + r^2*S3))
+  tsimd_f32x4 ps = tsimd_add_f32(tsimd_mul_n_f32(r2, -1.9515295891e-4f), tsimd_dup_f32(8.3321608736e-3f));
+  ps = tsimd_add_f32(tsimd_mul_f32(ps, r2), tsimd_dup_f32(-1.6666654611e-1f));
+  ps = tsimd_add_f32(tsimd_mul_f32(tsimd_mul_f32(ps, r2), r), r);
+
+  // cos(r) = 1 - r^2/2 + r^4*(C1 + r^2*(C2 + r^2*C3))
+  tsimd_f32x4 pc = tsimd_add_f32(tsimd_mul_n_f32(r2, 2.443315711809948e-5f), tsimd_dup_f32(-1.388731625493765e-3f));
+  pc = tsimd_add_f32(tsimd_mul_f32(pc, r2), tsimd_dup_f32(4.166664568298827e-2f));
+  pc = tsimd_mul_f32(tsimd_mul_f32(pc, r2), r2);
+  pc = tsimd_add_f32(tsimd_sub_f32(pc, tsimd_mul_n_f32(r2, 0.5f)), tsimd_dup_f32(1.0f));
+
+  // q mod 4 selects the quadrant
+  tsimd_f32x4 m = tsimd_sub_f32(q, tsimd_mul_n_f32(tsimd_floor_f32(tsimd_mul_n_f32(q, 0.25f)), 4.0f));
+  const tsimd_mask q1 = tsimd_eq_f32(m, tsimd_dup_f32(1.0f));
+  const tsimd_mask q2 = tsimd_eq_f32(m, tsimd_dup_f32(2.0f));
+  const tsimd_mask q3 = tsimd_eq_f32(m, tsimd_dup_f32(3.0f));
+  const tsimd_mask swap = tsimd_or_mask(q1, q3);
+  const tsimd_f32x4 zero = tsimd_dup_f32(0.0f);
+  tsimd_f32x4 sx = tsimd_select_f32(swap, pc, ps);
+  tsimd_f32x4 cx = tsimd_select_f32(swap, ps, pc);
+  *s = tsimd_select_f32(tsimd_or_mask(q2, q3), tsimd_sub_f32(zero, sx), sx);
+  *c = tsimd_select_f32(tsimd_or_mask(q1, q2), tsimd_sub_f32(zero, cx), cx);
+}
+
+/** Loads sixteen bytes. The pointer need not be aligned. */
+static inline tsimd_u8x16 tsimd_load_u8(const uint8_t *p) {
+#if TSIMD_NEON
+  return vld1q_u8(p);
+#elif TSIMD_SSE
+  return _mm_loadu_si128((const __m128i *) p);
+#else
+  tsimd_u8x16 x;
+  for (int i = 0; i < 16; ++i) x.u[i] = p[i];
+  return x;
+#endif
+}
+
+/** Stores sixteen bytes. The pointer need not be aligned. */
+static inline void tsimd_store_u8(uint8_t *p, tsimd_u8x16 x) {
+#if TSIMD_NEON
+  vst1q_u8(p, x);
+#elif TSIMD_SSE
+  _mm_storeu_si128((__m128i *) p, x);
+#else
+  for (int i = 0; i < 16; ++i) p[i] = x.u[i];
+#endif
+}
+
+/** Returns {a,0,0,0, a,0,0,0, a,0,0,0, a,0,0,0}, i.e. a in the first byte of every 32-bit word. */
+static inline tsimd_u8x16 tsimd_dup_u8_lane0(uint8_t a) {
+#if TSIMD_NEON
+  return vreinterpretq_u8_u32(vdupq_n_u32(a));
+#elif TSIMD_SSE
+  return _mm_set1_epi32(a);
+#else
+  tsimd_u8x16 x;
+  for (int i = 0; i < 16; ++i) x.u[i] = ((i & 3) == 0) ? a : 0;
+  return x;
+#endif
+}
+
+static inline tsimd_u8x16 tsimd_or_u8(tsimd_u8x16 a, tsimd_u8x16 b) {
+#if TSIMD_NEON
+  return vorrq_u8(a, b);
+#elif TSIMD_SSE
+  return _mm_or_si128(a, b);
+#else
+  tsimd_u8x16 x;
+  for (int i = 0; i < 16; ++i) x.u[i] = a.u[i] | b.u[i];
+  return x;
+#endif
+}
+
+static inline tsimd_u8x16 tsimd_and_u8(tsimd_u8x16 a, tsimd_u8x16 b) {
+#if TSIMD_NEON
+  return vandq_u8(a, b);
+#elif TSIMD_SSE
+  return _mm_and_si128(a, b);
+#else
+  tsimd_u8x16 x;
+  for (int i = 0; i < 16; ++i) x.u[i] = a.u[i] & b.u[i];
+  return x;
+#endif
+}
+
+/** Wrapping (modulo 256) byte-wise addition. */
+static inline tsimd_u8x16 tsimd_add_u8(tsimd_u8x16 a, tsimd_u8x16 b) {
+#if TSIMD_NEON
+  return vaddq_u8(a, b);
+#elif TSIMD_SSE
+  return _mm_add_epi8(a, b);
+#else
+  tsimd_u8x16 x;
+  for (int i = 0; i < 16; ++i) x.u[i] = (uint8_t) (a.u[i] + b.u[i]);
+  return x;
+#endif
+}
+
+/**
+ * Truncates sixteen floats to integers and narrows them to bytes, in order a, b, c, d.
+ * All values must be on the range [0,255].
+ */
+static inline tsimd_u8x16 tsimd_pack_u8(tsimd_f32x4 a, tsimd_f32x4 b, tsimd_f32x4 c, tsimd_f32x4 d) {
+#if TSIMD_NEON
+  uint8x8_t ab = vmovn_u16(vcombine_u16(vmovn_u32(vcvtq_u32_f32(a)), vmovn_u32(vcvtq_u32_f32(b))));
+  uint8x8_t cd = vmovn_u16(vcombine_u16(vmovn_u32(vcvtq_u32_f32(c)), vmovn_u32(vcvtq_u32_f32(d))));
+  return vcombine_u8(ab, cd);
+#elif TSIMD_SSE
+  __m128i ab = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+  __m128i cd = _mm_packs_epi32(_mm_cvttps_epi32(c), _mm_cvttps_epi32(d));
+  return _mm_packus_epi16(ab, cd);
+#else
+  tsimd_u8x16 x;
+  for (int i = 0; i < 4; ++i) {
+    x.u[i]    = (uint8_t) (uint32_t) a.f[i];
+    x.u[i+4]  = (uint8_t) (uint32_t) b.f[i];
+    x.u[i+8]  = (uint8_t) (uint32_t) c.f[i];
+    x.u[i+12] = (uint8_t) (uint32_t) d.f[i];
+  }
+  return x;
+#endif
+}
+
+/** Returns the sum of all sixteen bytes. */
+static inline uint32_t tsimd_sum_u8(tsimd_u8x16 a) {
+#if TSIMD_NEON
+  uint64x2_t x = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(a)));
+  return (uint32_t) (vgetq_lane_u64(x, 0) + vgetq_lane_u64(x, 1));
+#elif TSIMD_SSE
+  __m128i x = _mm_sad_epu8(a, _mm_setzero_si128()); // two partial sums of at most 2040
+  return (uint32_t) (_mm_cvtsi128_si32(x) + _mm_extract_epi16(x, 4));
+#else
+  uint32_t x = 0;
+  for (int i = 0; i < 16; ++i) x += a.u[i];
+  return x;
+#endif
+}
+
+/** Loads eight unsigned 16-bit integers. The pointer need not be aligned. */
+static inline tsimd_u16x8 tsimd_load_u16(const uint16_t *p) {
+#if TSIMD_NEON
+  return vld1q_u16(p);
+#elif TSIMD_SSE
+  return _mm_loadu_si128((const __m128i *) p);
+#else
+  tsimd_u16x8 x;
+  for (int i = 0; i < 8; ++i) x.u[i] = p[i];
+  return x;
+#endif
+}
+
+static inline void tsimd_store_u16(uint16_t *p, tsimd_u16x8 x) {
+#if TSIMD_NEON
+  vst1q_u16(p, x);
+#elif TSIMD_SSE
+  _mm_storeu_si128((__m128i *) p, x);
+#else
+  for (int i = 0; i < 8; ++i) p[i] = x.u[i];
+#endif
+}
+
+static inline tsimd_u16x8 tsimd_dup_u16(uint16_t a) {
+#if TSIMD_NEON
+  return vdupq_n_u16(a);
+#elif TSIMD_SSE
+  return _mm_set1_epi16((short) a);
+#else
+  tsimd_u16x8 x;
+  for (int i = 0; i < 8; ++i) x.u[i] = a;
+  return x;
+#endif
+}
+
+/** Saturating addition. */
+static inline tsimd_u16x8 tsimd_adds_u16(tsimd_u16x8 a, tsimd_u16x8 b) {
+#if TSIMD_NEON
+  return vqaddq_u16(a, b);
+#elif TSIMD_SSE
+  return _mm_adds_epu16(a, b);
+#else
+  tsimd_u16x8 x;
+  for (int i = 0; i < 8; ++i) {
+    const uint32_t y = (uint32_t) a.u[i] + b.u[i];
+    x.u[i] = (y > 0xFFFF) ? 0xFFFF : (uint16_t) y;
+  }
+  return x;
+#endif
+}
+
+/** Saturating subtraction, a-b or 0. */
+static inline tsimd_u16x8 tsimd_subs_u16(tsimd_u16x8 a, tsimd_u16x8 b) {
+#if TSIMD_NEON
+  return vqsubq_u16(a, b);
+#elif TSIMD_SSE
+  return _mm_subs_epu16(a, b);
+#else
+  tsimd_u16x8 x;
+  for (int i = 0; i < 8; ++i) x.u[i] = (a.u[i] > b.u[i]) ? a.u[i] - b.u[i] : 0;
+  return x;
+#endif
+}
+
+/** Returns the high half of the 32-bit product, (a*b) >> 16. */
+static inline tsimd_u16x8 tsimd_mulhi_u16(tsimd_u16x8 a, tsimd_u16x8 b) {
+#if TSIMD_NEON
+  uint32x4_t lo = vmull_u16(vget_low_u16(a), vget_low_u16(b));
+  uint32x4_t hi = vmull_u16(vget_high_u16(a), vget_high_u16(b));
+  return vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16));
+#elif TSIMD_SSE
+  return _mm_mulhi_epu16(a, b);
+#else
+  tsimd_u16x8 x;
+  for (int i = 0; i < 8; ++i) x.u[i] = (uint16_t) (((uint32_t) a.u[i] * b.u[i]) >> 16);
+  return x;
+#endif
+}
+
+/** Returns |a-b|. */
+static inline tsimd_u16x8 tsimd_absdiff_u16(tsimd_u16x8 a, tsimd_u16x8 b) {
+#if TSIMD_NEON
+  return vabdq_u16(a, b);
+#elif TSIMD_SSE
+  return _mm_or_si128(_mm_subs_epu16(a, b), _mm_subs_epu16(b, a));
+#else
+  tsimd_u16x8 x;
+  for (int i = 0; i < 8; ++i) x.u[i] = (a.u[i] > b.u[i]) ? a.u[i] - b.u[i] : b.u[i] - a.u[i];
+  return x;
+#endif
+}
+
+static inline tsimd_u16x8 tsimd_min_u16(tsimd_u16x8 a, tsimd_u16x8 b) {
+#if TSIMD_NEON
+  return vminq_u16(a, b);
+#elif TSIMD_SSE
+  return _mm_sub_epi16(a, _mm_subs_epu16(a, b)); // SSE2 has no unsigned 16-bit min
+#else
+  tsimd_u16x8 x;
+  for (int i = 0; i < 8; ++i) x.u[i] = (a.u[i] < b.u[i]) ? a.u[i] : b.u[i];
+  return x;
+#endif
+}
+
+/** Shifts every lane right by n bits, n in [0,15]. */
+static inline tsimd_u16x8 tsimd_shr_u16(tsimd_u16x8 a, int n) {
+#if TSIMD_NEON
+  return vshlq_u16(a, vdupq_n_s16((int16_t) -n)); // a negative left shift is a right shift
+#elif TSIMD_SSE
+  return _mm_srl_epi16(a, _mm_cvtsi32_si128(n));
+#else
+  tsimd_u16x8 x;
+  for (int i = 0; i < 8; ++i) x.u[i] = (uint16_t) (a.u[i] >> n);
+  return x;
+#endif
+}
+
+/**
+ * Truncates eight floats to unsigned 16-bit integers, a in the lower four lanes.
+ * Values outside of [0,65535] saturate.
+ */
+static inline tsimd_u16x8 tsimd_cvt_f32_u16(tsimd_f32x4 a, tsimd_f32x4 b) {
+  a = tsimd_min_f32(tsimd_max_f32(a, tsimd_dup_f32(0.0f)), tsimd_dup_f32(65535.0f));
+  b = tsimd_min_f32(tsimd_max_f32(b, tsimd_dup_f32(0.0f)), tsimd_dup_f32(65535.0f));
+#if TSIMD_NEON
+  return vcombine_u16(vmovn_u32(vcvtq_u32_f32(a)), vmovn_u32(vcvtq_u32_f32(b)));
+#elif TSIMD_SSE
+  // SSE2 can only narrow with signed saturation, so shift to the signed range and back
+  const __m128i BIAS32 = _mm_set1_epi32(32768);
+  __m128i x = _mm_packs_epi32(_mm_sub_epi32(_mm_cvttps_epi32(a), BIAS32), _mm_sub_epi32(_mm_cvttps_epi32(b), BIAS32));
+  return _mm_xor_si128(x, _mm_set1_epi16((short) 0x8000));
+#else
+  tsimd_u16x8 x;
+  for (int i = 0; i < 4; ++i) {
+    x.u[i] = (uint16_t) a.f[i];
+    x.u[i+4] = (uint16_t) b.f[i];
+  }
+  return x;
+#endif
+}
+
+/** Widens eight unsigned 16-bit integers to floats, the lower four lanes into lo. */
+static inline void tsimd_cvt_u16_f32(tsimd_u16x8 x, tsimd_f32x4 *lo, tsimd_f32x4 *hi) {
+#if TSIMD_NEON
+  *lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(x)));
+  *hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(x)));
+#elif TSIMD_SSE
+  *lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(x, _mm_setzero_si128()));
+  *hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(x, _mm_setzero_si128()));
+#else
+  for (int i = 0; i < 4; ++i) {
+    lo->f[i] = (float) x.u[i];
+    hi->f[i] = (float) x.u[i+4];
+  }
+#endif
+}
+
+/** Narrows sixteen unsigned 16-bit integers to bytes, a in the lower eight lanes. Saturates at 255. */
+static inline tsimd_u8x16 tsimd_pack_u16_u8(tsimd_u16x8 a, tsimd_u16x8 b) {
+#if TSIMD_NEON
+  return vcombine_u8(vqmovn_u16(a), vqmovn_u16(b));
+#elif TSIMD_SSE
+  // packus treats its input as signed, so clamp first
+  const __m128i MAX = _mm_set1_epi16(255);
+  return _mm_packus_epi16(tsimd_min_u16(a, MAX), tsimd_min_u16(b, MAX));
+#else
+  tsimd_u8x16 x;
+  for (int i = 0; i < 8; ++i) {
+    x.u[i] = (a.u[i] > 255) ? 255 : (uint8_t) a.u[i];
+    x.u[i+8] = (b.u[i] > 255) ? 255 : (uint8_t) b.u[i];
+  }
+  return x;
+#endif
+}
+
+/** Loads four unsigned 32-bit integers. The pointer need not be aligned. */
+static inline tsimd_u32x4 tsimd_load_u32(const uint32_t *p) {
+#if TSIMD_NEON
+  return vld1q_u32(p);
+#elif TSIMD_SSE
+  return _mm_loadu_si128((const __m128i *) p);
+#else
+  tsimd_u32x4 x = {{p[0], p[1], p[2], p[3]}};
+  return x;
+#endif
+}
+
+static inline void tsimd_store_u32(uint32_t *p, tsimd_u32x4 x) {
+#if TSIMD_NEON
+  vst1q_u32(p, x);
+#elif TSIMD_SSE
+  _mm_storeu_si128((__m128i *) p, x);
+#else
+  p[0] = x.u[0]; p[1] = x.u[1]; p[2] = x.u[2]; p[3] = x.u[3];
+#endif
+}
+
+static inline tsimd_u32x4 tsimd_dup_u32(uint32_t a) {
+#if TSIMD_NEON
+  return vdupq_n_u32(a);
+#elif TSIMD_SSE
+  return _mm_set1_epi32((int) a);
+#else
+  tsimd_u32x4 x = {{a, a, a, a}};
+  return x;
+#endif
+}
+
+/** Wrapping addition. */
+static inline tsimd_u32x4 tsimd_add_u32(tsimd_u32x4 a, tsimd_u32x4 b) {
+#if TSIMD_NEON
+  return vaddq_u32(a, b);
+#elif TSIMD_SSE
+  return _mm_add_epi32(a, b);
+#else
+  tsimd_u32x4 x;
+  for (int i = 0; i < 4; ++i) x.u[i] = a.u[i] + b.u[i];
+  return x;
+#endif
+}
+
+static inline tsimd_u32x4 tsimd_and_u32(tsimd_u32x4 a, tsimd_u32x4 b) {
+#if TSIMD_NEON
+  return vandq_u32(a, b);
+#elif TSIMD_SSE
+  return _mm_and_si128(a, b);
+#else
+  tsimd_u32x4 x;
+  for (int i = 0; i < 4; ++i) x.u[i] = a.u[i] & b.u[i];
+  return x;
+#endif
+}
+
+static inline tsimd_u32x4 tsimd_or_u32(tsimd_u32x4 a, tsimd_u32x4 b) {
+#if TSIMD_NEON
+  return vorrq_u32(a, b);
+#elif TSIMD_SSE
+  return _mm_or_si128(a, b);
+#else
+  tsimd_u32x4 x;
+  for (int i = 0; i < 4; ++i) x.u[i] = a.u[i] | b.u[i];
+  return x;
+#endif
+}
+
+static inline tsimd_u32x4 tsimd_xor_u32(tsimd_u32x4 a, tsimd_u32x4 b) {
+#if TSIMD_NEON
+  return veorq_u32(a, b);
+#elif TSIMD_SSE
+  return _mm_xor_si128(a, b);
+#else
+  tsimd_u32x4 x;
+  for (int i = 0; i < 4; ++i) x.u[i] = a.u[i] ^ b.u[i];
+  return x;
+#endif
+}
+
+/** Shifts left by n bits, 0 < n < 32. */
+static inline tsimd_u32x4 tsimd_shl_u32(tsimd_u32x4 a, int n) {
+#if TSIMD_NEON
+  return vshlq_u32(a, vdupq_n_s32(n));
+#elif TSIMD_SSE
+  return _mm_slli_epi32(a, n);
+#else
+  tsimd_u32x4 x;
+  for (int i = 0; i < 4; ++i) x.u[i] = a.u[i] << n;
+  return x;
+#endif
+}
+
+/** Shifts right by n bits, 0 < n < 32, shifting in zeros. */
+static inline tsimd_u32x4 tsimd_shr_u32(tsimd_u32x4 a, int n) {
+#if TSIMD_NEON
+  return vshlq_u32(a, vdupq_n_s32(-n)); // a negative left shift is a right shift
+#elif TSIMD_SSE
+  return _mm_srli_epi32(a, n);
+#else
+  tsimd_u32x4 x;
+  for (int i = 0; i < 4; ++i) x.u[i] = a.u[i] >> n;
+  return x;
+#endif
+}
+
+/** Rotates left by n bits, 0 < n < 32. */
+static inline tsimd_u32x4 tsimd_rotl_u32(tsimd_u32x4 a, int n) {
+  return tsimd_or_u32(tsimd_shl_u32(a, n), tsimd_shr_u32(a, 32-n));
+}
+
+/** Converts to float, rounding to nearest. Every lane must be less than 2^31. */
+static inline tsimd_f32x4 tsimd_cvt_u32_f32(tsimd_u32x4 a) {
+#if TSIMD_NEON
+  return vcvtq_f32_u32(a);
+#elif TSIMD_SSE
+  return _mm_cvtepi32_ps(a);
+#else
+  tsimd_f32x4 x;
+  for (int i = 0; i < 4; ++i) x.f[i] = (float) (int32_t) a.u[i];
+  return x;
+#endif
+}
+
+/** Reinterprets the bits of four floats as unsigned integers. */
+static inline tsimd_u32x4 tsimd_bits_f32_u32(tsimd_f32x4 a) {
+#if TSIMD_NEON
+  return vreinterpretq_u32_f32(a);
+#elif TSIMD_SSE
+  return _mm_castps_si128(a);
+#else
+  tsimd_u32x4 x;
+  memcpy(x.u, a.f, sizeof(x.u));
+  return x;
+#endif
+}
+
+/** Reinterprets four unsigned integers as the bits of floats. */
+static inline tsimd_f32x4 tsimd_bits_u32_f32(tsimd_u32x4 a) {
+#if TSIMD_NEON
+  return vreinterpretq_f32_u32(a);
+#elif TSIMD_SSE
+  return _mm_castsi128_ps(a);
+#else
+  tsimd_f32x4 x;
+  memcpy(x.f, a.u, sizeof(x.f));
+  return x;
+#endif
+}
+
+/**
+ * Computes the natural logarithm with a polynomial approximation (after Cephes logf).
+ * Every lane must be positive and normal. The relative error is below 1e-6.
+ */
+static inline tsimd_f32x4 tsimd_log_f32(tsimd_f32x4 a) {
+  // a = m * 2^e, with m in [sqrt(1/2), sqrt(2))
+  const tsimd_u32x4 bits = tsimd_bits_f32_u32(a);
+  tsimd_f32x4 e = tsimd_sub_f32(tsimd_cvt_u32_f32(tsimd_shr_u32(bits, 23)), tsimd_dup_f32(126.0f));
+  tsimd_f32x4 m = tsimd_bits_u32_f32(tsimd_or_u32(tsimd_and_u32(bits, tsimd_dup_u32(0x007FFFFF)),
+      tsimd_dup_u32(0x3F000000))); // [0.5,1)
+  const tsimd_mask isSmall = tsimd_lt_f32(m, tsimd_dup_f32(0.707106781186547524f));
+  e = tsimd_select_f32(isSmall, tsimd_sub_f32(e, tsimd_dup_f32(1.0f)), e);
+  m = tsimd_select_f32(isSmall, tsimd_add_f32(m, m), m);
+  const tsimd_f32x4 x = tsimd_sub_f32(m, tsimd_dup_f32(1.0f));
+  const tsimd_f32x4 z = tsimd_mul_f32(x, x);
+
+  // log(1+x) = x - x^2/2 + x^3*P(x)
+  tsimd_f32x4 p = tsimd_add_f32(tsimd_mul_n_f32(x, 7.0376836292e-2f), tsimd_dup_f32(-1.1514610310e-1f));
+  p = tsimd_add_f32(tsimd_mul_f32(p, x), tsimd_dup_f32(1.1676998740e-1f));
+  p = tsimd_add_f32(tsimd_mul_f32(p, x), tsimd_dup_f32(-1.2420140846e-1f));
+  p = tsimd_add_f32(tsimd_mul_f32(p, x), tsimd_dup_f32(1.4249322787e-1f));
+  p = tsimd_add_f32(tsimd_mul_f32(p, x), tsimd_dup_f32(-1.6668057665e-1f));
+  p = tsimd_add_f32(tsimd_mul_f32(p, x), tsimd_dup_f32(2.0000714765e-1f));
+  p = tsimd_add_f32(tsimd_mul_f32(p, x), tsimd_dup_f32(-2.4999993993e-1f));
+  p = tsimd_add_f32(tsimd_mul_f32(p, x), tsimd_dup_f32(3.3333331174e-1f));
+  tsimd_f32x4 y = tsimd_mul_f32(tsimd_mul_f32(p, x), z);
+
+  // add e*log(2), split in two for precision
+  y = tsimd_add_f32(y, tsimd_mul_n_f32(e, -2.12194440e-4f));
+  y = tsimd_sub_f32(y, tsimd_mul_n_f32(z, 0.5f));
+  return tsimd_add_f32(tsimd_add_f32(x, y), tsimd_mul_n_f32(e, 0.693359375f));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _TINY_SIMD_H_
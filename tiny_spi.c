@@ -23,10 +23,25 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 // http://www.raspberry-projects.com/pi/programming-in-c/spi/using-the-spi-interface
 #include "tiny_spi.h"
 
+// the kernel default, if the module parameter cannot be read
+#define SPIDEV_DEFAULT_BUFSIZ 4096
+
+static uint32_t tspi_read_bufsiz(void) {
+  uint32_t bufsiz = SPIDEV_DEFAULT_BUFSIZ;
+  FILE *f = fopen("/sys/module/spidev/parameters/bufsiz", "r");
+  if (f != NULL) {
+    char line[32];
+    if (fgets(line, sizeof(line), f) != NULL && atoi(line) > 0) bufsiz = (uint32_t) atoi(line);
+    fclose(f);
+  }
+  return bufsiz;
+}
+
 int tspi_open(TinySpi *tspi, const char *path, uint32_t spi_speed) {
   assert(tspi != NULL);
   assert(path != NULL);
@@ -60,6 +75,7 @@ int tspi_open(TinySpi *tspi, const char *path, uint32_t spi_speed) {
 
   tspi->fd = fd;
   tspi->speed = spi_speed;
+  tspi->bufsiz = tspi_read_bufsiz();
   return fd;
 }
 
@@ -77,23 +93,30 @@ int tspi_write(TinySpi *tspi, int num_bytes, uint8_t *data) {
   assert(data != NULL);
 
   // https://raspberrypi.stackexchange.com/questions/65595/spi-transfer-fails-with-buffer-size-greater-than-4096
-  // To change the default add spidev.bufsiz=65536 to /boot/cmdline.txt and reboot.
-  assert((num_bytes < 4096) && "SPI transfer size is too large.");
-
+  // spidev rejects any message whose transfers add up to more than bufsiz (4096 by default),
+  // so chaining several transfers into one SPI_IOC_MESSAGE(n) does not help. Instead the frame
+  // is split over several messages. APA-102s are clocked and have no chip select or latch,
+  // so the short pauses between messages do not matter.
+  // (The ceiling can still be raised with spidev.bufsiz=65536 in /boot/cmdline.txt, for fewer syscalls.)
   struct spi_ioc_transfer spi;
   memset(&spi, 0, sizeof(struct spi_ioc_transfer));
-  spi.tx_buf = (uint64_t) data;
   spi.rx_buf = 0; // don't care about receiving
-  spi.len = num_bytes;
   spi.delay_usecs = 0;
   spi.speed_hz = tspi->speed;
   spi.bits_per_word = 8;
   spi.cs_change = 0;
 
-  int ret = ioctl(tspi->fd, SPI_IOC_MESSAGE(1), &spi);
-  if (ret == -1) {
-    printf("TinySPI ioctl write fail: %s\n", strerror(errno));
-    assert(0 && "Error while sending SPI message.");
+  int ret = 0;
+  for (int i = 0; i < num_bytes; i += tspi->bufsiz) {
+    spi.tx_buf = (uint64_t) (uintptr_t) (data + i);
+    spi.len = ((uint32_t) (num_bytes - i) < tspi->bufsiz) ? (uint32_t) (num_bytes - i) : tspi->bufsiz;
+    int n = ioctl(tspi->fd, SPI_IOC_MESSAGE(1), &spi);
+    if (n == -1) {
+      printf("TinySPI ioctl write fail: %s\n", strerror(errno));
+      assert(0 && "Error while sending SPI message.");
+      return -1;
+    }
+    ret += n;
   }
 
   return ret;
@@ -26,6 +26,7 @@ extern "C" {
 typedef struct {
   int32_t fd;
   uint32_t speed; // hz
+  uint32_t bufsiz; // the largest message that spidev accepts, in bytes
 } TinySpi;
 
 int tspi_open(TinySpi *tspi, const char *path, uint32_t speed);
@@ -33,6 +34,9 @@ int tspi_open(TinySpi *tspi, const char *path, uint32_t speed);
 int tspi_close(TinySpi *tspi);
 
 /**
+ * Writes any number of bytes. Frames larger than spidev's bufsiz are sent
+ * as several consecutive messages.
+ *
  * @return  Returns the number of bytes written.
  */
 int tspi_write(TinySpi *tspi, int num_bytes, uint8_t *data);